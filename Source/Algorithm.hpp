@@ -2,7 +2,14 @@
 
 #include "Expression.hpp"
 #include <algorithm>
+#include <cstddef>
 #include <iterator>
+#include <optional>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <variant>
+#include <vector>
 
 namespace boss::algorithm {
 template <typename ContainerIt, typename Visitor>
@@ -11,7 +18,7 @@ void visitEach(ContainerIt begin, ContainerIt end, Visitor v) {
   for_each(begin, end, [&v](auto&& item) { visit([&v](auto&& item) { return v(item); }, item); });
 }
 
-template <typename Container, typename Visitor> void visitEach(Container c, Visitor v) {
+template <typename Container, typename Visitor> void visitEach(Container&& c, Visitor v) {
   visitEach(begin(c), end(c), std::forward<Visitor>(v));
 }
 
@@ -28,7 +35,7 @@ auto visitAccumulate(ContainerIt begin, ContainerIt end, Init i, Visitor v) {
 }
 
 template <typename Container, typename Init, typename Visitor>
-auto visitAccumulate(Container c, Init i, Visitor v) {
+auto visitAccumulate(Container&& c, Init i, Visitor v) {
   return visitAccumulate(begin(c), end(c), std::forward<Init>(i), std::forward<Visitor>(v));
 }
 
@@ -46,7 +53,7 @@ auto visitTransformAccumulate(ContainerIt begin, ContainerIt end, TransformVisit
 }
 
 template <typename Container, typename TransformVisitor, typename Init, typename AccumulateVisitor>
-auto visitTransformAccumulate(Container c, TransformVisitor t, Init i, AccumulateVisitor v) {
+auto visitTransformAccumulate(Container&& c, TransformVisitor t, Init i, AccumulateVisitor v) {
   return visitTransformAccumulate(begin(c), end(c), std::forward<TransformVisitor>(t),
                                   std::forward<Init>(i), std::forward<AccumulateVisitor>(v));
 }
@@ -65,4 +72,260 @@ auto visitTransform(Container& c, TransformVisitor t) {
   return visitTransform(begin(c), end(c), std::forward<TransformVisitor>(t));
 }
 
+/**
+ * true for spans that store their values contiguously (i.e., all but the packed bitmaps of bools)
+ */
+template <typename T> struct isContiguousSpan : std::false_type {};
+template <typename Scalar>
+struct isContiguousSpan<expressions::Span<Scalar>>
+    : std::bool_constant<!std::is_same_v<std::remove_const_t<Scalar>, bool>> {};
+
+template <typename Visitor, typename SpanType> inline constexpr bool acceptsSpanValues = false;
+template <typename Visitor, typename Scalar>
+inline constexpr bool acceptsSpanValues<Visitor, expressions::Span<Scalar>> =
+    isContiguousSpan<expressions::Span<Scalar>>::value &&
+    std::is_invocable_v<Visitor, Scalar const*, size_t>;
+
+/**
+ * Calls visitor(data, size) for each span argument of a complex expression (in order), data being
+ * a const pointer to the contiguous values of the span. Unlike iterating the arguments, this does
+ * not construct an ArgumentWrapper (and visit a variant) per value, i.e., the visitor can process
+ * the values in a plain loop. Null values are not skipped (see Span::isValid).
+ *
+ * Spans the visitor does not accept as (data, size) -- e.g., spans of another type than a typed
+ * visitor takes or spans without contiguous values (bitmaps, string and dictionary spans) -- are
+ * passed to visitor(span) instead. If the visitor does not accept those either, an
+ * invalid_argument exception is thrown. Dynamic arguments are not visited (see visitEach)
+ */
+template <typename ComplexExpression, typename Visitor>
+void forEachSpan(ComplexExpression const& expression, Visitor&& visitor) {
+  for(auto const& spanArgument : expression.getSpanArguments()) {
+    std::visit(
+        [&visitor](auto const& span) {
+          using SpanType = std::decay_t<decltype(span)>;
+          if constexpr(acceptsSpanValues<Visitor&, SpanType>) {
+            visitor(static_cast<std::add_const_t<std::remove_pointer_t<decltype(span.begin())>>*>(
+                        span.begin()),
+                    span.size());
+          } else if constexpr(std::is_invocable_v<Visitor&, SpanType const&>) {
+            visitor(span);
+          } else {
+            throw std::invalid_argument("forEachSpan visitor does not accept a span argument");
+          }
+        },
+        spanArgument);
+  }
+}
+
+/**
+ * What a traversal does after a subexpression has been visited
+ */
+enum class Traversal {
+  CONTINUE,       // walk the arguments of the subexpression (if they have not been walked yet)
+  SKIP_ARGUMENTS, // do not walk the arguments of the subexpression
+  STOP            // end the traversal
+};
+
+/**
+ * calls a traversal callback and maps its result to a Traversal (callbacks returning nothing
+ * continue, callbacks returning false skip the arguments)
+ */
+template <typename Callback, typename... Arguments>
+Traversal invokeTraversalCallback(Callback& callback, Arguments const&... arguments) {
+  using Result = std::invoke_result_t<Callback&, Arguments const&...>;
+  if constexpr(std::is_same_v<Result, Traversal>) {
+    return callback(arguments...);
+  } else if constexpr(std::is_same_v<Result, bool>) {
+    return callback(arguments...) ? Traversal::CONTINUE : Traversal::SKIP_ARGUMENTS;
+  } else {
+    callback(arguments...);
+    return Traversal::CONTINUE;
+  }
+}
+
+/**
+ * Walks the complex subexpressions of an expression (the expression itself included) depth-first
+ * with an explicit stack, i.e., in bounded call-stack space no matter how deep the expression is.
+ * enter(subexpression, depth) is called before the (dynamic) complex arguments of a subexpression
+ * are walked and leave(subexpression, depth) after them. Both may return a Traversal: if enter
+ * returns SKIP_ARGUMENTS (or false), the arguments of the subexpression are skipped (leave is still
+ * called), if either returns STOP, the traversal ends. Returns false if the traversal was stopped
+ */
+template <typename Enter, typename Leave, typename... AdditionalCustomAtoms>
+bool traverse(expressions::generic::ComplexExpressionWithAdditionalCustomAtoms<
+                  std::tuple<>, AdditionalCustomAtoms...> const& expression,
+              Enter&& enter, Leave&& leave) {
+  using ComplexExpression =
+      expressions::generic::ComplexExpressionWithAdditionalCustomAtoms<std::tuple<>,
+                                                                       AdditionalCustomAtoms...>;
+  struct Frame {
+    ComplexExpression const* expression;
+    size_t nextArgument;
+  };
+  auto frames = std::vector<Frame>();
+  auto visit = [&](ComplexExpression const& subexpression) {
+    auto const depth = frames.size();
+    auto const traversal = invokeTraversalCallback(enter, subexpression, depth);
+    if(traversal == Traversal::CONTINUE) {
+      frames.push_back({&subexpression, 0});
+      return true;
+    }
+    return traversal != Traversal::STOP &&
+           invokeTraversalCallback(leave, subexpression, depth) != Traversal::STOP;
+  };
+  if(!visit(expression)) {
+    return false;
+  }
+  while(!frames.empty()) {
+    auto& frame = frames.back();
+    auto const& arguments = frame.expression->getDynamicArguments();
+    while(frame.nextArgument < arguments.size() &&
+          !std::holds_alternative<ComplexExpression>(arguments[frame.nextArgument])) {
+      frame.nextArgument++;
+    }
+    if(frame.nextArgument == arguments.size()) {
+      auto const* subexpression = frame.expression;
+      frames.pop_back();
+      if(invokeTraversalCallback(leave, *subexpression, frames.size()) == Traversal::STOP) {
+        return false;
+      }
+      continue;
+    }
+    if(!visit(std::get<ComplexExpression>(arguments[frame.nextArgument++]))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+template <typename Enter, typename... AdditionalCustomAtoms>
+bool traverse(expressions::generic::ComplexExpressionWithAdditionalCustomAtoms<
+                  std::tuple<>, AdditionalCustomAtoms...> const& expression,
+              Enter&& enter) {
+  return traverse(expression, std::forward<Enter>(enter), [](auto const& /*unused*/, size_t) {});
+}
+
+/**
+ * calls visitor(subexpression) for the complex subexpressions of an expression, parents before
+ * their arguments (see traverse for the results the visitor may return)
+ */
+template <typename Visitor, typename... AdditionalCustomAtoms>
+bool forEachPreOrder(expressions::generic::ComplexExpressionWithAdditionalCustomAtoms<
+                         std::tuple<>, AdditionalCustomAtoms...> const& expression,
+                     Visitor&& visitor) {
+  return traverse(expression, [&visitor](auto const& subexpression, size_t /*depth*/) {
+    return invokeTraversalCallback(visitor, subexpression);
+  });
+}
+
+/**
+ * calls visitor(subexpression) for the complex subexpressions of an expression, arguments before
+ * their parents. The traversal ends if the visitor returns Traversal::STOP
+ */
+template <typename Visitor, typename... AdditionalCustomAtoms>
+bool forEachPostOrder(expressions::generic::ComplexExpressionWithAdditionalCustomAtoms<
+                          std::tuple<>, AdditionalCustomAtoms...> const& expression,
+                      Visitor&& visitor) {
+  return traverse(
+      expression, [](auto const& /*subexpression*/, size_t /*depth*/) {},
+      [&visitor](auto const& subexpression, size_t /*depth*/) {
+        return invokeTraversalCallback(visitor, subexpression);
+      });
+}
+
+/**
+ * Rewrites an expression bottom-up: rewriter(subexpression) is called with every complex
+ * subexpression (as an rvalue, after its complex arguments have been rewritten) and returns the
+ * expression that replaces it. Subexpressions are moved, never copied: the rewritten arguments are
+ * assigned to the argument vector of their parent, i.e., the storage of the nodes is reused (and a
+ * rewriter that returns its argument unchanged costs a move). Uses an explicit stack (see
+ * traverse).
+ *
+ * enter(subexpression, depth) is called before the arguments of a subexpression are rewritten and
+ * may return a Traversal (see traverse): if it returns SKIP_ARGUMENTS (or false), the arguments are
+ * left untouched (the subexpression itself is still rewritten), if it returns STOP, the rewrite
+ * ends and everything that has not been rewritten yet (including the ancestors of the
+ * subexpression) is left in place
+ */
+template <typename Enter, typename Rewriter, typename... AdditionalCustomAtoms>
+expressions::generic::ExpressionWithAdditionalCustomAtoms<AdditionalCustomAtoms...>
+rewriteBottomUp(expressions::generic::ComplexExpressionWithAdditionalCustomAtoms<
+                    std::tuple<>, AdditionalCustomAtoms...>&& expression,
+                Enter&& enter, Rewriter&& rewriter) {
+  using ComplexExpression =
+      expressions::generic::ComplexExpressionWithAdditionalCustomAtoms<std::tuple<>,
+                                                                       AdditionalCustomAtoms...>;
+  using Expression = expressions::generic::ExpressionWithAdditionalCustomAtoms<
+      AdditionalCustomAtoms...>;
+  struct Frame {
+    expressions::Symbol head;
+    expressions::generic::ExpressionArgumentsWithAdditionalCustomAtoms<AdditionalCustomAtoms...>
+        arguments;
+    expressions::generic::ExpressionSpanArgumentsWithAdditionalCustomAtoms<
+        AdditionalCustomAtoms...>
+        spanArguments;
+    size_t nextArgument;
+  };
+  auto frames = std::vector<Frame>();
+  auto stopped = false;
+  /*
+   * returns the expression that replaces the subexpression or nothing if its arguments need to be
+   * rewritten first (a frame is pushed for them)
+   */
+  auto enterSubexpression =
+      [&frames, &stopped, &enter,
+       &rewriter](ComplexExpression&& subexpression) -> std::optional<Expression> {
+    auto const traversal = invokeTraversalCallback(enter, subexpression, frames.size());
+    if(traversal == Traversal::STOP) {
+      stopped = true;
+      return Expression(std::move(subexpression));
+    }
+    if(traversal == Traversal::SKIP_ARGUMENTS) {
+      return Expression(rewriter(std::move(subexpression)));
+    }
+    auto [head, _unused, arguments, spanArguments] = std::move(subexpression).decompose();
+    frames.push_back({std::move(head), std::move(arguments), std::move(spanArguments), 0});
+    return {};
+  };
+  if(auto result = enterSubexpression(std::move(expression))) {
+    return std::move(*result);
+  }
+  while(true) {
+    auto& frame = frames.back();
+    while(frame.nextArgument < frame.arguments.size() &&
+          (stopped ||
+           !std::holds_alternative<ComplexExpression>(frame.arguments[frame.nextArgument]))) {
+      frame.nextArgument++;
+    }
+    if(frame.nextArgument < frame.arguments.size()) {
+      auto& argument = frame.arguments[frame.nextArgument];
+      if(auto result = enterSubexpression(std::get<ComplexExpression>(std::move(argument)))) {
+        argument = std::move(*result);
+        frame.nextArgument++;
+      }
+      continue;
+    }
+    auto subexpression = ComplexExpression(std::move(frame.head), {}, std::move(frame.arguments),
+                                           std::move(frame.spanArguments));
+    auto result = stopped ? Expression(std::move(subexpression))
+                          : Expression(rewriter(std::move(subexpression)));
+    frames.pop_back();
+    if(frames.empty()) {
+      return result;
+    }
+    auto& parent = frames.back();
+    parent.arguments[parent.nextArgument++] = std::move(result);
+  }
+}
+
+template <typename Rewriter, typename... AdditionalCustomAtoms>
+expressions::generic::ExpressionWithAdditionalCustomAtoms<AdditionalCustomAtoms...>
+rewriteBottomUp(expressions::generic::ComplexExpressionWithAdditionalCustomAtoms<
+                    std::tuple<>, AdditionalCustomAtoms...>&& expression,
+                Rewriter&& rewriter) {
+  return rewriteBottomUp(
+      std::move(expression), [](auto const& /*unused*/, size_t) {},
+      std::forward<Rewriter>(rewriter));
+}
+
 } // namespace boss::algorithm
@@ -71,6 +71,7 @@ BOSSSymbol* symbolNameToNewBOSSSymbol(char const* name) {
 BOSSExpression* newComplexBOSSExpression(BOSSSymbol* head, size_t cardinality,
                                          BOSSExpression* arguments[]) {
   auto args = boss::ExpressionArguments();
+  args.reserve(cardinality);
   ::std::transform(arguments, arguments + cardinality, ::std::back_insert_iterator(args),
                    [](auto const* a) {
                      return a->delegate.clone(CloneReason::CONVERSION_TO_C_BOSS_EXPRESSION);
@@ -159,6 +160,10 @@ BOSSExpression** getArgumentsFromBOSSExpression(BOSSExpression const* arg) {
   return result;
 }
 
+bool getArgumentValidityFromBOSSExpression(BOSSExpression const* arg, size_t index) {
+  return get<boss::ComplexExpression>(arg->delegate).getArguments().isValid(index);
+}
+
 void freeBOSSExpression(BOSSExpression* expression) {
   delete expression; // NOLINT
 }
@@ -44,6 +44,10 @@ char const* getNewSymbolNameFromBOSSExpression(struct BOSSExpression const* arg)
 struct BOSSSymbol* getHeadFromBOSSExpression(struct BOSSExpression const* arg);
 size_t getArgumentCountFromBOSSExpression(struct BOSSExpression const* arg);
 struct BOSSExpression** getArgumentsFromBOSSExpression(struct BOSSExpression const* arg);
+/**
+ * false if the argument is null (i.e., an invalid value of a nullable span argument)
+ */
+bool getArgumentValidityFromBOSSExpression(struct BOSSExpression const* arg, size_t index);
 
 struct BOSSExpression* BOSSEvaluate(struct BOSSExpression* arg);
 void freeBOSSExpression(struct BOSSExpression* expression);
@@ -53,6 +53,7 @@ static void* dlsym(void* hModule, LPCSTR lpProcName) {
 #endif // _WIN32
 
 #include <algorithm>
+#include <initializer_list>
 #include <iterator>
 #include <numeric>
 #include <optional>
@@ -60,6 +61,7 @@ static void* dlsym(void* hModule, LPCSTR lpProcName) {
 #include <unordered_map>
 #include <unordered_set>
 #include <variant>
+#include <vector>
 
 namespace boss {
 namespace engines {
@@ -112,64 +114,124 @@ class BootstrapEngine : public boss::Engine {
 
   ::std::vector<::std::string> defaultEngine = {};
 
-  ::std::unordered_map<boss::Symbol,
-                       ::std::function<boss::Expression(boss::ComplexExpression&&)>> const
-      registeredOperators{
-          {boss::Symbol("EvaluateInEngines"),
-           [this](auto&& e) -> boss::Expression {
-             auto symbols = ::std::vector<BOSSExpression* (*)(BOSSExpression*)>();
-             auto args = get<ComplexExpression>(e.getArguments().at(0)).getArguments();
-             ::std::for_each(args.begin(), args.end(), [this, &e, &symbols](auto&& enginePath) {
-               symbols.push_back(reinterpret_cast<BOSSExpression* (*)(BOSSExpression*)>(
-                   libraries.at(get<::std::string>(enginePath)).evaluateFunction));
-             });
-             ::std::for_each(
-                 ::std::make_move_iterator(::std::next(
-                     e.getArguments().begin())), // Note: first argument is the engine path
-                 ::std::make_move_iterator(::std::prev(e.getArguments().end())),
-                 [&symbols](auto&& argument) {
-                   auto* wrapper = new BOSSExpression{::std::forward<decltype(argument)>(argument)};
-                   for(auto sym : symbols) {
-                     auto* oldWrapper = wrapper;
-                     wrapper = (sym(wrapper));
-                     freeBOSSExpression(oldWrapper);
-                   }
-                   freeBOSSExpression(wrapper);
-                 });
-
-             auto* r = new BOSSExpression{*::std::prev(e.getArguments().end())};
-             for(auto sym : symbols) {
-               auto* oldWrapper = r;
-               r = sym(r);
-               freeBOSSExpression(oldWrapper);
-             }
-             auto result = ::std::move(r->delegate);
-             freeBOSSExpression(r); // NOLINT
-             return ::std::move(result);
-           }},
-          {boss::Symbol("SetDefaultEnginePipeline"),
-           [this](auto&& expression) -> boss::Expression {
-             algorithm::visitEach(expression.getArguments(), [this](auto&& engine) {
-               if constexpr(::std::is_same_v<::std::decay_t<decltype(engine)>, ::std::string>) {
-                 defaultEngine.push_back(engine);
-               } else {
-                 throw std::runtime_error("SetDefaultEnginePipeline received non-string argument");
-               }
-             });
-             return "okay";
-           }},
-          {boss::Symbol("ResetEngines"), [this](auto&& /*expression*/) -> boss::Expression {
-             libraries.clear();
-             return "okay";
-           }}};
-  bool isBootstrapCommand(boss::Expression const& expression) {
-    return visit(utilities::overload(
-                     [this](boss::ComplexExpression const& expression) {
-                       return registeredOperators.count(expression.getHead()) > 0;
-                     },
-                     [](auto const& /* unused */
-                     ) { return false; }),
-                 expression);
+  boss::Expression evaluateInEngines(boss::ComplexExpression&& e) {
+    auto symbols = ::std::vector<BOSSExpression* (*)(BOSSExpression*)>();
+    auto args = get<ComplexExpression>(e.getArguments().at(0)).getArguments();
+    ::std::for_each(args.begin(), args.end(), [this, &e, &symbols](auto&& enginePath) {
+      symbols.push_back(reinterpret_cast<BOSSExpression* (*)(BOSSExpression*)>(
+          libraries.at(get<::std::string>(enginePath)).evaluateFunction));
+    });
+    ::std::for_each(
+        ::std::make_move_iterator(
+            ::std::next(e.getArguments().begin())), // Note: first argument is the engine path
+        ::std::make_move_iterator(::std::prev(e.getArguments().end())),
+        [&symbols](auto&& argument) {
+          auto* wrapper = new BOSSExpression{::std::forward<decltype(argument)>(argument)};
+          for(auto sym : symbols) {
+            auto* oldWrapper = wrapper;
+            wrapper = (sym(wrapper));
+            freeBOSSExpression(oldWrapper);
+          }
+          freeBOSSExpression(wrapper);
+        });
+
+    auto* r = new BOSSExpression{*::std::prev(e.getArguments().end())};
+    for(auto sym : symbols) {
+      auto* oldWrapper = r;
+      r = sym(r);
+      freeBOSSExpression(oldWrapper);
+    }
+    auto result = ::std::move(r->delegate);
+    freeBOSSExpression(r); // NOLINT
+    return ::std::move(result);
+  }
+
+  boss::Expression setDefaultEnginePipeline(boss::ComplexExpression&& expression) {
+    algorithm::visitEach(expression.getArguments(), [this](auto&& engine) {
+      if constexpr(::std::is_same_v<::std::decay_t<decltype(engine)>, ::std::string>) {
+        defaultEngine.push_back(engine);
+      } else {
+        throw std::runtime_error("SetDefaultEnginePipeline received non-string argument");
+      }
+    });
+    return "okay";
+  }
+
+  boss::Expression resetEngines(boss::ComplexExpression&& /*expression*/) {
+    libraries.clear();
+    return "okay";
+  }
+
+  /**
+   * The (summed) memory footprint of the (evaluated) arguments as
+   * Footprint[Owned[bytes], Shared[bytes], Borrowed[bytes]] (see MemoryFootprint). Buffers that
+   * are shared between the arguments are counted once
+   */
+  boss::Expression memoryFootprint(boss::ComplexExpression&& expression) {
+    using boss::utilities::operator""_;
+    auto total = MemoryFootprint{};
+    auto counted = SharedBuffers();
+    for(auto const& argument : expression.getDynamicArguments()) {
+      total += footprint(argument, &counted);
+    }
+    for(auto const& spanArgument : expression.getSpanArguments()) {
+      total += ::std::visit([&counted](auto const& span) { return span.footprint(&counted); },
+                            spanArgument);
+    }
+    return "Footprint"_("Owned"_(static_cast<int64_t>(total.owned)),
+                        "Shared"_(static_cast<int64_t>(total.shared)),
+                        "Borrowed"_(static_cast<int64_t>(total.borrowed)));
+  }
+
+  using Operator = boss::Expression (BootstrapEngine::*)(boss::ComplexExpression&&);
+
+  /**
+   * The operators are dispatched through a flat table that is indexed by the (dense) id of the
+   * head symbol. It is built once per process and a lookup is a single probe. The head is stored
+   * along with the operator so that a symbol which was interned in a different table (and happens
+   * to have the same id) does not get dispatched.
+   */
+  class OperatorTable {
+    struct RegisteredOperator {
+      boss::Symbol head;
+      Operator implementation;
+    };
+    ::std::vector<::std::optional<RegisteredOperator>> operators;
+
+  public:
+    OperatorTable(::std::initializer_list<RegisteredOperator> registeredOperators) {
+      for(auto const& op : registeredOperators) {
+        if(op.head.getId() >= operators.size()) {
+          operators.resize(op.head.getId() + 1);
+        }
+        operators[op.head.getId()] = op;
+      }
+    }
+
+    Operator find(boss::Symbol const& head) const {
+      if(head.getId() >= operators.size()) {
+        return nullptr;
+      }
+      auto const& op = operators[head.getId()];
+      return op.has_value() && op->head == head ? op->implementation : nullptr;
+    }
+  };
+
+  static OperatorTable const& registeredOperators() {
+    static auto const table =
+        OperatorTable{{boss::Symbol("EvaluateInEngines"), &BootstrapEngine::evaluateInEngines},
+                      {boss::Symbol("SetDefaultEnginePipeline"),
+                       &BootstrapEngine::setDefaultEnginePipeline},
+                      {boss::Symbol("ResetEngines"), &BootstrapEngine::resetEngines},
+                      {boss::Symbol("MemoryFootprint"), &BootstrapEngine::memoryFootprint}};
+    return table;
+  }
+
+  boss::Expression evaluateInDefaultEngines(boss::Expression&& e) {
+    using boss::utilities::operator""_;
+    return evaluateInEngines(evaluateArguments("EvaluateInEngines"_(
+        "List"_(Span<::std::string>(defaultEngine.data(), defaultEngine.size(), nullptr)),
+        std::move(e))));
   }
 
 public:
@@ -180,7 +242,7 @@ public:
   BootstrapEngine& operator=(BootstrapEngine const&) = delete;
   BootstrapEngine& operator=(BootstrapEngine&&) = delete;
 
-  auto evaluateArguments(boss::ComplexExpression&& expr) {
+  boss::ComplexExpression evaluateArguments(boss::ComplexExpression&& expr) {
     ::std::transform(::std::make_move_iterator(begin(expr.getArguments())),
                      ::std::make_move_iterator(end(expr.getArguments())),
                      begin(expr.getArguments()),
@@ -188,26 +250,31 @@ public:
     return ::std::move(expr);
   }
 
-  // NOLINTNEXTLINE(readability-convert-member-functions-to-static)
+  /**
+   * Root expressions that are not bootstrap commands are evaluated in the default engine pipeline
+   * (if one is set)
+   */
   boss::Expression evaluate(boss::Expression&& e, bool isRootExpression = true) {
-    using boss::utilities::operator""_;
-
-    auto wrappedE =
-        isRootExpression && !defaultEngine.empty() && !isBootstrapCommand(e)
-            ? "EvaluateInEngines"_(
-                  "List"_(Span<::std::string>(defaultEngine.data(), defaultEngine.size(), nullptr)),
-                  std::move(e))
-            : std::move(e);
-    return ::std::visit(boss::utilities::overload(
-                            [this](boss::ComplexExpression&& unevaluatedE) -> boss::Expression {
-                              if(registeredOperators.count(unevaluatedE.getHead()) == 0) {
-                                return ::std::move(unevaluatedE);
-                              }
-                              auto const& op = registeredOperators.at(unevaluatedE.getHead());
-                              return op(evaluateArguments(::std::move(unevaluatedE)));
-                            },
-                            [](auto&& e) -> boss::Expression { return e; }),
-                        ::std::forward<boss::Expression>(wrappedE));
+    auto const useDefaultEngines = isRootExpression && !defaultEngine.empty();
+    return ::std::visit(
+        boss::utilities::overload(
+            [this, useDefaultEngines](boss::ComplexExpression&& unevaluatedE) -> boss::Expression {
+              auto const op = registeredOperators().find(unevaluatedE.getHead());
+              if(op == nullptr) {
+                if(useDefaultEngines) {
+                  return evaluateInDefaultEngines(::std::move(unevaluatedE));
+                }
+                return ::std::move(unevaluatedE);
+              }
+              return (this->*op)(evaluateArguments(::std::move(unevaluatedE)));
+            },
+            [this, useDefaultEngines](auto&& e) -> boss::Expression {
+              if(useDefaultEngines) {
+                return evaluateInDefaultEngines(::std::forward<decltype(e)>(e));
+              }
+              return e;
+            }),
+        ::std::move(e));
   }
 };
 } // namespace
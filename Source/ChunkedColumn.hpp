@@ -0,0 +1,211 @@
+#pragma once
+
+#include "Expression.hpp"
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace boss::expressions {
+/**
+ * One logical column made of several chunks (spans) of values. Appending a chunk or concatenating
+ * columns moves the spans (the values are never copied) which makes ingesting (micro-)batches
+ * linear in the number of batches.
+ *
+ * Chunks map one-to-one to span arguments of complex expressions (see toSpanArguments and
+ * fromSpanArguments). Values are located with a binary search over the (cached) offsets of the
+ * chunks, bulk processing should go chunk by chunk (see forEachChunk)
+ */
+template <typename Scalar> class ChunkedColumn {
+  std::vector<Span<Scalar>> chunks;
+  std::vector<size_t> offsets = {0}; // offsets[i] is the position of the first value of chunk i
+
+  /**
+   * recomputes the offsets of the chunks from firstChunk on (dropping empty chunks)
+   */
+  void updateOffsets(size_t firstChunk = 0) {
+    chunks.erase(std::remove_if(chunks.begin() + firstChunk, chunks.end(),
+                                [](auto const& chunk) { return chunk.size() == 0; }),
+                 chunks.end());
+    offsets.resize(chunks.size() + 1);
+    for(auto i = firstChunk; i < chunks.size(); i++) {
+      offsets[i + 1] = offsets[i] + chunks[i].size();
+    }
+  }
+
+public:
+  ChunkedColumn() = default;
+  explicit ChunkedColumn(Span<Scalar>&& chunk) { append(std::move(chunk)); }
+
+  ChunkedColumn(ChunkedColumn const&) = delete;
+  ChunkedColumn& operator=(ChunkedColumn const&) = delete;
+  ChunkedColumn(ChunkedColumn&&) noexcept = default;
+  ChunkedColumn& operator=(ChunkedColumn&&) noexcept = default;
+  ~ChunkedColumn() = default;
+
+  size_t size() const { return offsets.back(); }
+  bool empty() const { return size() == 0; }
+  size_t chunkCount() const { return chunks.size(); }
+  /**
+   * Chunks are only accessible as const (replacing one by a span of a different size would
+   * invalidate the offsets), use replaceChunk to replace one. Values can be modified through
+   * operator[] and the iterators
+   */
+  Span<Scalar> const& chunk(size_t index) const { return chunks.at(index); }
+  size_t chunkOffset(size_t index) const { return offsets.at(index); }
+
+  /**
+   * replaces the chunk at index (which may have a different size or be empty) and returns the
+   * replaced one
+   */
+  Span<Scalar> replaceChunk(size_t index, Span<Scalar>&& chunk) {
+    auto replaced = std::exchange(chunks.at(index), std::move(chunk));
+    updateOffsets(index);
+    return replaced;
+  }
+
+  ChunkedColumn& append(Span<Scalar>&& chunk) {
+    if(chunk.size() > 0) {
+      offsets.push_back(size() + chunk.size());
+      chunks.push_back(std::move(chunk));
+    }
+    return *this;
+  }
+
+  ChunkedColumn& append(ChunkedColumn&& other) {
+    chunks.reserve(chunks.size() + other.chunks.size());
+    for(auto& chunk : other.chunks) {
+      append(std::move(chunk));
+    }
+    other = ChunkedColumn();
+    return *this;
+  }
+
+  static ChunkedColumn concat(ChunkedColumn&& first, ChunkedColumn&& second) {
+    return std::move(first.append(std::move(second)));
+  }
+
+  /**
+   * the index of the chunk holding the value at position index
+   */
+  size_t chunkIndexOf(size_t index) const {
+    return std::upper_bound(offsets.begin(), offsets.end(), index) - offsets.begin() - 1;
+  }
+
+  decltype(auto) operator[](size_t index) const {
+    auto const chunkIndex = chunkIndexOf(index);
+    return chunks[chunkIndex][index - offsets[chunkIndex]];
+  }
+  decltype(auto) operator[](size_t index) {
+    auto const chunkIndex = chunkIndexOf(index);
+    return chunks[chunkIndex][index - offsets[chunkIndex]];
+  }
+  decltype(auto) at(size_t index) const {
+    if(index >= size()) {
+      throw std::out_of_range("ChunkedColumn has no element with index " + std::to_string(index));
+    }
+    return (*this)[index];
+  }
+  decltype(auto) at(size_t index) {
+    if(index >= size()) {
+      throw std::out_of_range("ChunkedColumn has no element with index " + std::to_string(index));
+    }
+    return (*this)[index];
+  }
+
+  /**
+   * calls visitor(chunk, offset) for each chunk (in order), offset being the position of the first
+   * value of the chunk in the column
+   */
+  template <typename Visitor> void forEachChunk(Visitor&& visitor) const {
+    for(auto i = 0U; i < chunks.size(); i++) {
+      visitor(chunks[i], offsets[i]);
+    }
+  }
+  /**
+   * the visitor may modify or replace chunks (the offsets are updated afterwards)
+   */
+  template <typename Visitor> void forEachChunk(Visitor&& visitor) {
+    for(auto i = 0U; i < chunks.size(); i++) {
+      visitor(chunks[i], offsets[i]);
+    }
+    updateOffsets();
+  }
+
+  /**
+   * Iterates over the values chunk by chunk: advancing the iterator only steps to the next chunk
+   * at the end of a chunk (no search)
+   */
+  template <bool Const> class Iterator {
+    using Column = std::conditional_t<Const, ChunkedColumn const, ChunkedColumn>;
+    Column* column = nullptr;
+    size_t chunkIndex = 0;
+    size_t position = 0; // within the chunk
+
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = std::remove_const_t<Scalar>;
+    using difference_type = std::ptrdiff_t;
+    using pointer = void;
+    using reference = decltype(std::declval<Column&>().chunks[0][0]);
+
+    Iterator() = default;
+    Iterator(Column* column, size_t chunkIndex) : column(column), chunkIndex(chunkIndex) {}
+
+    reference operator*() const { return column->chunks[chunkIndex][position]; }
+    Iterator& operator++() {
+      if(++position == column->chunks[chunkIndex].size()) {
+        ++chunkIndex;
+        position = 0;
+      }
+      return *this;
+    }
+    Iterator operator++(int) { return std::exchange(*this, std::next(*this)); }
+    bool operator==(Iterator const& other) const {
+      return chunkIndex == other.chunkIndex && position == other.position;
+    }
+    bool operator!=(Iterator const& other) const { return !(*this == other); }
+  };
+
+  auto begin() const { return Iterator<true>(this, 0); }
+  auto end() const { return Iterator<true>(this, chunks.size()); }
+  auto begin() { return Iterator<false>(this, 0); }
+  auto end() { return Iterator<false>(this, chunks.size()); }
+
+  /**
+   * moves the chunks into span arguments (e.g., to construct a complex expression from them)
+   */
+  template <typename... AdditionalCustomAtoms>
+  generic::ExpressionSpanArgumentsWithAdditionalCustomAtoms<AdditionalCustomAtoms...>
+  toSpanArguments() && {
+    auto result =
+        generic::ExpressionSpanArgumentsWithAdditionalCustomAtoms<AdditionalCustomAtoms...>();
+    result.reserve(chunks.size());
+    std::move(chunks.begin(), chunks.end(), std::back_inserter(result));
+    *this = ChunkedColumn();
+    return result;
+  }
+
+  /**
+   * takes the span arguments (e.g., of a complex expression) as the chunks of a column. All of
+   * them need to be spans of Scalar
+   */
+  template <typename... AdditionalCustomAtoms>
+  static ChunkedColumn fromSpanArguments(
+      generic::ExpressionSpanArgumentsWithAdditionalCustomAtoms<AdditionalCustomAtoms...>&&
+          spanArguments) {
+    auto result = ChunkedColumn();
+    result.chunks.reserve(spanArguments.size());
+    for(auto& spanArgument : spanArguments) {
+      if(!std::holds_alternative<Span<Scalar>>(spanArgument)) {
+        throw std::bad_variant_access();
+      }
+      result.append(std::get<Span<Scalar>>(std::move(spanArgument)));
+    }
+    return result;
+  }
+};
+} // namespace boss::expressions
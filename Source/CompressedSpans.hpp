@@ -0,0 +1,289 @@
+#pragma once
+
+#include "Expression.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+/**
+ * Lightweight compressed encodings of integer (e.g., key or date) columns. Values are decoded one
+ * at a time with operator[] or in bulk with decode() -- predicates can be evaluated without
+ * decoding (see the compressed overloads of the kernels in Kernels.hpp)
+ */
+namespace boss::expressions {
+/**
+ * Frame-of-reference encoding with bit-packing: values are stored as their (unsigned) offset from
+ * the smallest value (the reference), packed with the minimal number of bits needed for the
+ * largest offset. A column of keys or dates with a range of less than 2^16 values is, thus,
+ * compressed to 16 bits per value
+ */
+template <typename Integer> class FrameOfReferenceSpan {
+  static_assert(std::is_integral_v<Integer> && !std::is_same_v<Integer, bool>,
+                "only integers can be frame-of-reference encoded");
+  using Unsigned = std::make_unsigned_t<Integer>;
+  static constexpr auto bitsPerWord = size_t{64};
+
+  Integer reference{};
+  size_t bitWidth = 0;
+  size_t count = 0;
+  /**
+   * the packed offsets followed by a (zero) padding word so that every offset can be read from
+   * two consecutive words without bounds checks
+   */
+  Span<std::uint64_t const> words;
+
+public:
+  FrameOfReferenceSpan() = default;
+  FrameOfReferenceSpan(Integer reference, size_t bitWidth, size_t count,
+                       Span<std::uint64_t const>&& words)
+      : reference(reference), bitWidth(bitWidth), count(count), words(std::move(words)) {
+    if(this->words.size() < (count * bitWidth + bitsPerWord - 1) / bitsPerWord + 1) {
+      throw std::invalid_argument("frame-of-reference encoding of " + std::to_string(count) +
+                                  " values is missing words");
+    }
+  }
+
+  /**
+   * Encodes values (a span or vector of integers) using the smallest value as the reference
+   */
+  template <typename Values> static FrameOfReferenceSpan encode(Values const& values) {
+    if(values.size() == 0) {
+      return {Integer{}, 0, 0, Span<std::uint64_t const>(std::vector<std::uint64_t>(1))};
+    }
+    auto const [min, max] = std::minmax_element(values.begin(), values.end());
+    auto const reference = Integer(*min);
+    auto const range = std::uint64_t(Unsigned(*max) - Unsigned(reference));
+    auto bitWidth = size_t{};
+    while(bitWidth < bitsPerWord && (range >> bitWidth) != 0) {
+      bitWidth++;
+    }
+    auto words = std::vector<std::uint64_t>(
+        (values.size() * bitWidth + bitsPerWord - 1) / bitsPerWord + 1);
+    if(bitWidth > 0) {
+      for(auto i = size_t{}; i < values.size(); i++) {
+        auto const offset = std::uint64_t(Unsigned(values[i]) - Unsigned(reference));
+        auto const bitIndex = i * bitWidth;
+        auto const shift = bitIndex % bitsPerWord;
+        words[bitIndex / bitsPerWord] |= offset << shift;
+        if(shift + bitWidth > bitsPerWord) {
+          words[bitIndex / bitsPerWord + 1] |= offset >> (bitsPerWord - shift);
+        }
+      }
+    }
+    return {reference, bitWidth, values.size(), Span<std::uint64_t const>(std::move(words))};
+  }
+
+  size_t size() const { return count; }
+  Integer getReference() const { return reference; }
+  size_t getBitWidth() const { return bitWidth; }
+  Span<std::uint64_t const> const& getWords() const { return words; }
+
+  /**
+   * the mask selecting the bits of a single (packed) offset
+   */
+  std::uint64_t mask() const {
+    return bitWidth == bitsPerWord ? ~std::uint64_t{} : (std::uint64_t{1} << bitWidth) - 1;
+  }
+
+  /**
+   * the offset of the index-th value from the reference (i.e., the value without decoding it)
+   */
+  std::uint64_t getOffset(size_t index) const {
+    if(bitWidth == 0) {
+      return 0;
+    }
+    auto const bitIndex = index * bitWidth;
+    auto const shift = bitIndex % bitsPerWord;
+    auto const low = words[bitIndex / bitsPerWord] >> shift;
+    auto const high = shift == 0 ? 0 : words[bitIndex / bitsPerWord + 1] << (bitsPerWord - shift);
+    return (low | high) & mask();
+  }
+
+  Integer operator[](size_t index) const {
+    return Integer(Unsigned(reference) + Unsigned(getOffset(index)));
+  }
+  Integer at(size_t index) const {
+    if(index < size()) {
+      return (*this)[index];
+    }
+    throw std::out_of_range("FrameOfReferenceSpan has no element with index " +
+                            std::to_string(index));
+  }
+
+#if defined(__AVX2__)
+  // NOLINTBEGIN(cppcoreguidelines-pro-type-reinterpret-cast)
+  /**
+   * the offsets of the four values starting at index as 64-bit lanes (gathering the two words each
+   * offset may span)
+   */
+  __m256i loadOffsets64(size_t index) const {
+    auto const bitIndex = index * bitWidth;
+    auto const* base = reinterpret_cast<long long const*>(words.begin()) + bitIndex / bitsPerWord;
+    auto const bitIndices = _mm256_add_epi64(
+        _mm256_set1_epi64x(static_cast<long long>(bitIndex % bitsPerWord)),
+        _mm256_set_epi64x(3 * bitWidth, 2 * bitWidth, bitWidth, 0));
+    auto const wordIndices = _mm256_srli_epi64(bitIndices, 6);
+    auto const shifts = _mm256_and_si256(bitIndices, _mm256_set1_epi64x(bitsPerWord - 1));
+    auto const low = _mm256_srlv_epi64(_mm256_i64gather_epi64(base, wordIndices, 8), shifts);
+    auto const nextWords =
+        _mm256_i64gather_epi64(base, _mm256_add_epi64(wordIndices, _mm256_set1_epi64x(1)), 8);
+    // shifting left by 64 yields zero which handles offsets that do not span two words
+    auto const high = _mm256_sllv_epi64(
+        nextWords, _mm256_sub_epi64(_mm256_set1_epi64x(bitsPerWord), shifts));
+    return _mm256_and_si256(_mm256_or_si256(low, high),
+                            _mm256_set1_epi64x(static_cast<long long>(mask())));
+  }
+
+  /**
+   * the offsets of the eight values starting at index as 32-bit lanes (the bit width must be at
+   * most 32): the packed words are gathered as 32-bit words so that twice as many offsets are
+   * unpacked per instruction
+   */
+  __m256i loadOffsets32(size_t index) const {
+    constexpr auto bitsPerLane = 32;
+    auto const bitIndex = index * bitWidth;
+    auto const* base = reinterpret_cast<int const*>(words.begin()) + bitIndex / bitsPerLane;
+    auto const width = static_cast<int>(bitWidth);
+    auto const bitIndices =
+        _mm256_add_epi32(_mm256_set1_epi32(static_cast<int>(bitIndex % bitsPerLane)),
+                         _mm256_setr_epi32(0, width, 2 * width, 3 * width, 4 * width, 5 * width,
+                                           6 * width, 7 * width));
+    auto const wordIndices = _mm256_srli_epi32(bitIndices, 5);
+    auto const shifts = _mm256_and_si256(bitIndices, _mm256_set1_epi32(bitsPerLane - 1));
+    auto const low = _mm256_srlv_epi32(_mm256_i32gather_epi32(base, wordIndices, 4), shifts);
+    auto const nextWords =
+        _mm256_i32gather_epi32(base, _mm256_add_epi32(wordIndices, _mm256_set1_epi32(1)), 4);
+    // shifting left by 32 yields zero which handles offsets that do not span two words
+    auto const high =
+        _mm256_sllv_epi32(nextWords, _mm256_sub_epi32(_mm256_set1_epi32(bitsPerLane), shifts));
+    return _mm256_and_si256(_mm256_or_si256(low, high),
+                            _mm256_set1_epi32(static_cast<int>(mask())));
+  }
+  // NOLINTEND(cppcoreguidelines-pro-type-reinterpret-cast)
+#endif
+
+  /**
+   * Decodes all values into a new (cache-line aligned) span. With AVX2, four 64-bit or eight 32-bit
+   * values are decoded at a time
+   */
+  Span<Integer> decode() const {
+    if(count == 0) {
+      return {};
+    }
+    auto result = Span<Integer>::allocateAligned(count);
+    auto i = size_t{};
+#if defined(__AVX2__)
+    // NOLINTBEGIN(cppcoreguidelines-pro-type-reinterpret-cast)
+    if constexpr(sizeof(Integer) == sizeof(std::uint64_t)) {
+      auto const references = _mm256_set1_epi64x(static_cast<long long>(reference));
+      for(; i + 4 <= count; i += 4) {
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(&result[i]),
+                            _mm256_add_epi64(loadOffsets64(i), references));
+      }
+    } else if constexpr(sizeof(Integer) == sizeof(std::uint32_t)) {
+      auto const references = _mm256_set1_epi32(static_cast<int>(reference));
+      for(; i + 8 <= count; i += 8) {
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(&result[i]),
+                            _mm256_add_epi32(loadOffsets32(i), references));
+      }
+    }
+    // NOLINTEND(cppcoreguidelines-pro-type-reinterpret-cast)
+#endif
+    for(; i < count; i++) {
+      result[i] = (*this)[i];
+    }
+    return result;
+  }
+
+  template <typename... Reason> FrameOfReferenceSpan clone(Reason... reason) const& {
+    return {reference, bitWidth, count, words.clone(reason...)};
+  }
+};
+
+/**
+ * Run-length encoding: runs of equal values are stored as one value and the (exclusive) end
+ * position of the run. Sorted or clustered columns (e.g., order keys of line items) compress to
+ * the number of runs
+ */
+template <typename Integer> class RunLengthSpan {
+  static_assert(std::is_integral_v<Integer> && !std::is_same_v<Integer, bool>,
+                "only integers can be run-length encoded");
+  Span<Integer const> values;
+  Span<std::int64_t const> runEnds;
+
+public:
+  RunLengthSpan() = default;
+  RunLengthSpan(Span<Integer const>&& values, Span<std::int64_t const>&& runEnds)
+      : values(std::move(values)), runEnds(std::move(runEnds)) {
+    if(this->values.size() != this->runEnds.size()) {
+      throw std::invalid_argument("run-length encoding has " +
+                                  std::to_string(this->values.size()) + " values but " +
+                                  std::to_string(this->runEnds.size()) + " runs");
+    }
+  }
+
+  /**
+   * Encodes values (a span or vector of integers)
+   */
+  template <typename Values> static RunLengthSpan encode(Values const& values) {
+    auto runValues = std::vector<Integer>();
+    auto ends = std::vector<std::int64_t>();
+    for(auto i = size_t{}; i < values.size(); i++) {
+      if(runValues.empty() || runValues.back() != values[i]) {
+        runValues.push_back(values[i]);
+        ends.push_back(0);
+      }
+      ends.back() = static_cast<std::int64_t>(i + 1);
+    }
+    return {Span<Integer const>(std::move(runValues)),
+            Span<std::int64_t const>(std::move(ends))};
+  }
+
+  size_t size() const { return runEnds.size() == 0 ? 0 : runEnds[runEnds.size() - 1]; }
+  size_t runCount() const { return runEnds.size(); }
+  Span<Integer const> const& getValues() const { return values; }
+  Span<std::int64_t const> const& getRunEnds() const { return runEnds; }
+
+  /**
+   * the index of the run holding the index-th value (a binary search)
+   */
+  size_t runOf(size_t index) const {
+    return std::upper_bound(runEnds.begin(), runEnds.end(), static_cast<std::int64_t>(index)) -
+           runEnds.begin();
+  }
+  size_t runBegin(size_t run) const { return run == 0 ? 0 : runEnds[run - 1]; }
+
+  Integer operator[](size_t index) const { return values[runOf(index)]; }
+  Integer at(size_t index) const {
+    if(index < size()) {
+      return (*this)[index];
+    }
+    throw std::out_of_range("RunLengthSpan has no element with index " + std::to_string(index));
+  }
+
+  /**
+   * Decodes all values into a new (cache-line aligned) span, filling a run at a time
+   */
+  Span<Integer> decode() const {
+    if(size() == 0) {
+      return {};
+    }
+    auto result = Span<Integer>::allocateAligned(size());
+    for(auto run = size_t{}; run < runCount(); run++) {
+      std::fill(result.begin() + runBegin(run), result.begin() + runEnds[run], values[run]);
+    }
+    return result;
+  }
+
+  template <typename... Reason> RunLengthSpan clone(Reason... reason) const& {
+    return {values.clone(reason...), runEnds.clone(reason...)};
+  }
+};
+} // namespace boss::expressions
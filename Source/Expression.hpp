@@ -1,18 +1,31 @@
 #pragma once
 #include "Utilities.hpp"
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <cmath>
 #include <cstdint>
+#include <cstring>
+#include <deque>
 #include <functional>
 #include <iterator>
 #include <map>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <new>
 #include <numeric>
+#include <optional>
+#include <shared_mutex>
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 #include <tuple>
 #include <type_traits>
 #include <typeindex>
+#include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <variant>
 #include <vector>
@@ -31,38 +44,524 @@ enum class CloneReason {
   EXPRESSION_WRAPPING,       // use expression as argument for another complex expression
   EXPRESSION_SUBSTITUTION,   // modifying arguments (includes argument evaluation)
   EXPRESSION_AUGMENTATION,   // adding new arguments
+  SHARED_EXPRESSION,         // materializing a (hash-consed) SharedExpressionNode
 };
-static void checkCloneWithoutReason(CloneReason reason) {}
-[[deprecated("Provide a reason type instead")]] static void checkCloneWithoutReason() {}
+
+/**
+ * Counts the clones per reason to find the call sites that still copy (e.g., the ones that could
+ * use shared spans instead, see ComplexExpression::share). Counting is disabled by default (and
+ * then costs a relaxed load per clone). Nested clones (of subexpressions and spans) are counted as
+ * well
+ */
+class CloneCounters {
+  static constexpr auto reasons = static_cast<size_t>(CloneReason::SHARED_EXPRESSION) + 1;
+  std::atomic<bool> enabled{false};
+  std::array<std::atomic<size_t>, reasons> counts{};
+
+public:
+  static CloneCounters& global() {
+    static CloneCounters counters;
+    return counters;
+  }
+
+  void enable(bool enable = true) { enabled.store(enable, std::memory_order_relaxed); }
+  bool isEnabled() const { return enabled.load(std::memory_order_relaxed); }
+
+  void count(CloneReason reason) {
+    if(isEnabled()) {
+      counts.at(static_cast<size_t>(reason)).fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+  size_t operator[](CloneReason reason) const {
+    return counts.at(static_cast<size_t>(reason)).load(std::memory_order_relaxed);
+  }
+  void reset() {
+    for(auto& count : counts) {
+      count.store(0, std::memory_order_relaxed);
+    }
+  }
+};
+
+inline void checkCloneWithoutReason(CloneReason reason) { CloneCounters::global().count(reason); }
+[[deprecated("Provide a reason type instead")]] inline void checkCloneWithoutReason() {}
+
+/**
+ * The bytes held by (a subtree of) an expression, by ownership. Owned bytes are held exclusively:
+ * argument vectors, strings and the values of owning spans (including mapped files). Shared bytes
+ * are reference-counted buffers of shared spans and dictionaries which other spans may reference
+ * as well. Borrowed bytes are referenced by non-owning spans (their adaptee is owned elsewhere).
+ * Symbols are interned in the process-wide symbol table and not accounted for
+ */
+struct MemoryFootprint {
+  size_t owned = 0;
+  size_t shared = 0;
+  size_t borrowed = 0;
+
+  size_t total() const { return owned + shared + borrowed; }
+  MemoryFootprint& operator+=(MemoryFootprint const& other) {
+    owned += other.owned;
+    shared += other.shared;
+    borrowed += other.borrowed;
+    return *this;
+  }
+  friend MemoryFootprint operator+(MemoryFootprint left, MemoryFootprint const& right) {
+    return left += right;
+  }
+};
+
+/**
+ * The shared buffers (span owners and dictionaries) that were already accounted for while computing
+ * a footprint: a buffer that is referenced by several spans is only counted once
+ */
+using SharedBuffers = std::unordered_set<void const*>;
+
+/**
+ * the bytes a string allocated (none if the characters fit into the string object itself)
+ */
+inline size_t allocatedBytes(std::string const& string) {
+  return string.capacity() > std::string().capacity() ? string.capacity() + 1 : 0;
+}
 
 namespace atoms {
+/**
+ * FNV-1a hash of a symbol name. It is constexpr so the hash of a name that is known at compile time
+ * can be computed at compile time as well
+ */
+constexpr std::uint64_t hashSymbolName(std::string_view name) noexcept {
+  auto hash = std::uint64_t{0xcbf29ce484222325ULL}; // NOLINT(readability-magic-numbers)
+  for(auto character : name) {
+    hash = (hash ^ static_cast<unsigned char>(character)) * 0x100000001b3ULL; // NOLINT
+  }
+  return hash;
+}
+
+/**
+ * Process-wide table of all symbol names. Every distinct name is stored exactly once and assigned a
+ * small, dense id (in order of first use). Entries are never removed so references to them (and to
+ * their names) stay valid for the lifetime of the process.
+ *
+ * There must be exactly one table per process: engines have to use the host's copy (i.e., global()
+ * must not be duplicated by loading an engine with its own, hidden copy of it). Symbols are
+ * compared by entry and operators are dispatched by id, neither works across tables
+ */
+class SymbolTable {
+public:
+  struct Entry {
+    std::string const name;
+    std::uint64_t const hash;
+    std::uint32_t const id;
+  };
+
+  static SymbolTable& global() {
+    static SymbolTable table;
+    return table;
+  }
+
+  Entry const& intern(std::string_view name, std::uint64_t hash) {
+    {
+      auto const lock = std::shared_lock(mutex);
+      if(auto const* entry = find(name, hash)) {
+        return *entry;
+      }
+    }
+    auto const lock = std::unique_lock(mutex);
+    if(auto const* entry = find(name, hash)) { // somebody might have beaten us to it
+      return *entry;
+    }
+    auto const id = static_cast<std::uint32_t>(entries.size());
+    auto const& entry = entries.emplace_back(Entry{std::string(name), hash, id});
+    index.emplace(hash, &entry);
+    return entry;
+  }
+  Entry const& intern(std::string_view name) { return intern(name, hashSymbolName(name)); }
+
+  Entry const& at(std::uint32_t id) const {
+    auto const lock = std::shared_lock(mutex);
+    return entries.at(id);
+  }
+
+  size_t size() const {
+    auto const lock = std::shared_lock(mutex);
+    return entries.size();
+  }
+
+  SymbolTable(SymbolTable const&) = delete;
+  SymbolTable(SymbolTable&&) = delete;
+  SymbolTable& operator=(SymbolTable const&) = delete;
+  SymbolTable& operator=(SymbolTable&&) = delete;
+  ~SymbolTable() = default;
+
+private:
+  SymbolTable() = default;
+
+  struct PrecomputedHash {
+    size_t operator()(std::uint64_t hash) const noexcept { return hash; }
+  };
+
+  Entry const* find(std::string_view name, std::uint64_t hash) const {
+    auto [candidate, end] = index.equal_range(hash);
+    for(; candidate != end; ++candidate) {
+      if(candidate->second->name == name) {
+        return candidate->second;
+      }
+    }
+    return nullptr;
+  }
+
+  mutable std::shared_mutex mutex;
+  std::deque<Entry> entries; // a deque does not move its elements when growing
+  std::unordered_multimap<std::uint64_t, Entry const*, PrecomputedHash> index;
+};
+
 // NOLINTBEGIN(bugprone-exception-escape)
 // see https://github.com/llvm/llvm-project/issues/54668
+/**
+ * Symbols are handles to entries in the (process-wide) SymbolTable: they are as cheap to copy as a
+ * pointer, hashing is free and equality is a pointer comparison. Creating a symbol interns the name
+ * (which may allocate and, thus, throw)
+ */
 class Symbol {
-  std::string name;
+  SymbolTable::Entry const* entry;
 
 public:
-  explicit Symbol(std::string name) noexcept : name(std::move(name)){};
-  std::string const& getName() const& { return name; };
-  std::string getName() && { return std::move(name); };
-  inline bool operator==(Symbol const& other) const { return getName() == other.getName(); };
-  inline bool operator!=(Symbol const& other) const { return getName() != other.getName(); };
+  explicit Symbol(std::string_view name) : entry(&SymbolTable::global().intern(name)){};
+  /**
+   * for callers that have already computed the hash of the name (e.g., at compile time). The hash
+   * must be hashSymbolName(name)
+   */
+  Symbol(std::string_view name, std::uint64_t hash)
+      : entry(&SymbolTable::global().intern(name, hash)){};
+  std::string const& getName() const& { return entry->name; };
+  std::string getName() && { return entry->name; };
+  std::uint32_t getId() const { return entry->id; }
+  std::uint64_t getHash() const { return entry->hash; }
+  inline bool operator==(Symbol const& other) const { return entry == other.entry; };
+  inline bool operator!=(Symbol const& other) const { return !(*this == other); };
   friend ::std::ostream& operator<<(::std::ostream& out, Symbol const& thing) {
     return out << thing.getName();
   }
 };
 // NOLINTEND(bugprone-exception-escape)
 
+/**
+ * Reference to a single bit of a packed bitmap. It is the mutable counterpart of Scalar& for
+ * Span<bool> (like BitReference, assigning to it writes the bit)
+ */
+class BitReference {
+  std::uint64_t* word;
+  std::uint64_t mask;
+
+public:
+  BitReference(std::uint64_t* word, std::uint64_t mask) noexcept : word(word), mask(mask) {}
+  BitReference(BitReference const&) noexcept = default;
+  BitReference(BitReference&&) noexcept = default;
+  ~BitReference() = default;
+
+  operator bool() const noexcept { // NOLINT(hicpp-explicit-conversions)
+    return (*word & mask) != 0;
+  }
+  BitReference& operator=(bool value) noexcept {
+    *word = value ? (*word | mask) : (*word & ~mask);
+    return *this;
+  }
+  BitReference& operator=(BitReference const& other) noexcept { return *this = bool(other); }
+  BitReference& operator=(BitReference&& other) noexcept { return *this = bool(other); }
+};
+/**
+ * Bits of const bitmaps are accessed by value
+ */
+using ConstBitReference = bool;
+
+/**
+ * Random-access iterator over the bits of a packed bitmap. Bit i of a bitmap is bit i % 64
+ * (counting from the least significant bit) of word i / 64
+ */
+template <bool Const> class BitIterator {
+public:
+  static constexpr auto bitsPerWord = std::ptrdiff_t{64};
+  using Word = std::conditional_t<Const, std::uint64_t const, std::uint64_t>;
+  using iterator_category = std::random_access_iterator_tag;
+  using value_type = bool;
+  using difference_type = std::ptrdiff_t;
+  using pointer = void;
+  using reference = std::conditional_t<Const, ConstBitReference, BitReference>;
+
+private:
+  Word* words = nullptr;
+  difference_type index = 0;
+
+public:
+  BitIterator() noexcept = default;
+  BitIterator(Word* words, difference_type index) noexcept : words(words), index(index) {}
+  template <bool IsConst = Const, typename = std::enable_if_t<!IsConst>>
+  operator BitIterator<true>() const noexcept { // NOLINT(hicpp-explicit-conversions)
+    return {words, index};
+  }
+
+  Word* getWords() const noexcept { return words; }
+  difference_type getIndex() const noexcept { return index; }
+  /**
+   * the word holding the bit the iterator points to
+   */
+  Word* word() const noexcept { return words + index / bitsPerWord; }
+  size_t bit() const noexcept { return index % bitsPerWord; }
+
+  /**
+   * the next (up to 64) bits starting at the iterator, packed into the low bits of a word. Only
+   * words holding at least one of these bits are read
+   */
+  std::uint64_t loadWord(size_t bits = bitsPerWord) const noexcept {
+    auto const offset = bit();
+    auto result = *word() >> offset;
+    if(offset != 0 && offset + bits > bitsPerWord) {
+      result |= word()[1] << (bitsPerWord - offset);
+    }
+    return bits < bitsPerWord ? result & ((std::uint64_t{1} << bits) - 1) : result;
+  }
+
+  reference operator*() const noexcept {
+    if constexpr(Const) {
+      return ((*word() >> bit()) & 1U) != 0;
+    } else {
+      return BitReference(word(), std::uint64_t{1} << bit());
+    }
+  }
+  reference operator[](difference_type offset) const noexcept { return *(*this + offset); }
+
+  BitIterator& operator++() noexcept { return *this += 1; }
+  BitIterator& operator--() noexcept { return *this -= 1; }
+  BitIterator operator++(int) noexcept { return std::exchange(*this, *this + 1); }
+  BitIterator operator--(int) noexcept { return std::exchange(*this, *this - 1); }
+  BitIterator& operator+=(difference_type offset) noexcept {
+    index += offset;
+    return *this;
+  }
+  BitIterator& operator-=(difference_type offset) noexcept { return *this += -offset; }
+  BitIterator operator+(difference_type offset) const noexcept { return {words, index + offset}; }
+  BitIterator operator-(difference_type offset) const noexcept { return {words, index - offset}; }
+  friend BitIterator operator+(difference_type offset, BitIterator const& it) noexcept {
+    return it + offset;
+  }
+  difference_type operator-(BitIterator const& other) const noexcept {
+    return (words - other.words) * bitsPerWord + index - other.index;
+  }
+
+  bool operator==(BitIterator const& other) const noexcept { return (*this - other) == 0; }
+  bool operator!=(BitIterator const& other) const noexcept { return (*this - other) != 0; }
+  bool operator<(BitIterator const& other) const noexcept { return (*this - other) < 0; }
+  bool operator>(BitIterator const& other) const noexcept { return (*this - other) > 0; }
+  bool operator<=(BitIterator const& other) const noexcept { return (*this - other) <= 0; }
+  bool operator>=(BitIterator const& other) const noexcept { return (*this - other) >= 0; }
+};
+
+/**
+ * The (intrusively) reference-counted owner of a buffer that is shared by several spans. It wraps
+ * the owner and release function of the span that was shared
+ */
+struct SharedSpanOwner {
+  std::atomic<size_t> references{1};
+  void* owner;
+  void (*release)(void*);
+
+  SharedSpanOwner(void* owner, void (*release)(void*)) : owner(owner), release(release) {}
+  void acquire() { references.fetch_add(1, std::memory_order_relaxed); }
+  void releaseReference() {
+    if(references.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      if(release != nullptr) {
+        release(owner);
+      }
+      delete this; // NOLINT(cppcoreguidelines-owning-memory)
+    }
+  }
+  bool isExclusive() const { return references.load(std::memory_order_acquire) == 1; }
+  /**
+   * the release function of spans that share a buffer (they are tagged by Span::shared)
+   */
+  static void releaseShared(void* sharedOwner) {
+    static_cast<SharedSpanOwner*>(sharedOwner)->releaseReference();
+  }
+};
+
+/**
+ * A HyperLogLog sketch estimating the number of distinct values (with a standard error of about
+ * 3%) in a single pass and constant (1KB) memory
+ */
+class DistinctCountEstimator {
+  static constexpr size_t bucketBits = 10;
+  static constexpr size_t buckets = size_t{1} << bucketBits;
+  std::array<std::uint8_t, buckets> ranks{};
+
+public:
+  void add(std::uint64_t hash) {
+    // std::hash is the identity for integers on some platforms, so the bits are mixed first
+    hash = (hash ^ (hash >> 30U)) * 0xbf58476d1ce4e5b9ULL;
+    hash = (hash ^ (hash >> 27U)) * 0x94d049bb133111ebULL;
+    hash ^= hash >> 31U;
+    auto const bucket = hash >> (64 - bucketBits);
+    auto remainder = hash << bucketBits;
+    auto rank = std::uint8_t{1};
+    for(; rank <= 64 - bucketBits && (remainder >> 63U) == 0; rank++) {
+      remainder <<= 1U;
+    }
+    ranks[bucket] = std::max(ranks[bucket], rank);
+  }
+
+  size_t estimate() const {
+    auto sum = 0.0;
+    auto emptyBuckets = size_t{};
+    for(auto rank : ranks) {
+      sum += std::ldexp(1.0, -rank);
+      emptyBuckets += rank == 0 ? 1 : 0;
+    }
+    auto const m = static_cast<double>(buckets);
+    auto const estimate = 0.7213 / (1 + 1.079 / m) * m * m / sum;
+    if(estimate <= 2.5 * m && emptyBuckets > 0) { // small range correction (linear counting)
+      return static_cast<size_t>(std::round(m * std::log(m / static_cast<double>(emptyBuckets))));
+    }
+    return static_cast<size_t>(std::round(estimate));
+  }
+};
+
+/**
+ * Statistics of the values of a span (see Span::statistics()). Null values are ignored: min and
+ * max are empty if there are no valid values and sorted refers to the valid values only
+ */
+template <typename Value> struct SpanStatistics {
+  std::optional<Value> min;
+  std::optional<Value> max;
+  size_t nullCount = 0;
+  bool sorted = true; // in ascending order
+  size_t distinctCount = 0; // an estimate (see DistinctCountEstimator)
+};
+
+/**
+ * A (possibly owning) view on a contiguous range of values. Spans of bools are packed bitmaps (64
+ * values per word) which can be processed a word at a time (see words() and Kernels.hpp)
+ */
 template <typename Scalar> struct Span {
 private: // state
-  using IteratorType = std::conditional_t<
-      std::is_same_v<std::remove_const_t<Scalar>, bool>,
-      std::conditional_t<std::is_const_v<Scalar>, typename std::vector<bool>::const_iterator,
-                         typename std::vector<bool>::iterator>,
-      Scalar*>;
+  static constexpr bool isBitmap = std::is_same_v<std::remove_const_t<Scalar>, bool>;
+  using IteratorType = std::conditional_t<isBitmap, BitIterator<std::is_const_v<Scalar>>, Scalar*>;
   IteratorType _begin = {};
   IteratorType _end = {};
-  std::function<void(void)> destructor;
+  /**
+   * The owner of the values is type-erased: release(owner) is called when the span is destroyed.
+   * Non-owning spans have neither. Spans that share their buffer (see share()) point to a
+   * SharedSpanOwner and their release function is SharedSpanOwner::releaseShared
+   */
+  void* owner = nullptr;
+  void (*release)(void*) = nullptr;
+  /**
+   * see alignment()
+   */
+  std::uint32_t _alignment = alignof(Scalar);
+  /**
+   * true if owner is a SharedSpanOwner (see isShared()). It is a flag rather than a comparison of
+   * release with SharedSpanOwner::releaseShared because the address of an inline function is not
+   * unique across shared libraries
+   */
+  bool shared = false;
+  /**
+   * see getValidity()
+   */
+  std::unique_ptr<Span<bool>> validity;
+  /**
+   * see statistics()
+   */
+  using Statistics = SpanStatistics<std::remove_const_t<Scalar>>;
+  mutable std::atomic<Statistics*> cachedStatistics{nullptr};
+
+  template <typename> friend struct Span;
+  Span(IteratorType begin, IteratorType end, SharedSpanOwner* sharedOwner, size_t alignment)
+      : _begin(begin), _end(end), owner(sharedOwner), release(&SharedSpanOwner::releaseShared),
+        _alignment(static_cast<std::uint32_t>(alignment)), shared(true) {
+    sharedOwner->acquire();
+  }
+
+  template <size_t Alignment> static void releaseAligned(void* buffer) {
+    ::operator delete(buffer, std::align_val_t{Alignment});
+  }
+
+  static void deleteAdaptee(void* adaptee) {
+    delete static_cast<std::vector<std::remove_const_t<Scalar>>*>(adaptee); // NOLINT
+  }
+  static void deleteWords(void* words) {
+    delete static_cast<std::vector<std::uint64_t>*>(words); // NOLINT
+  }
+
+  static auto withoutConst(IteratorType it) {
+    if constexpr(isBitmap) {
+      return BitIterator<false>(const_cast<std::uint64_t*>(it.getWords()), it.getIndex());
+    } else {
+      return const_cast<std::remove_const_t<Scalar>*>(it);
+    }
+  }
+
+  /**
+   * copies the values into a new (owning) span. Bitmaps are copied a word at a time
+   */
+  template <typename Target> static Span<Target> copyOf(IteratorType begin, IteratorType end) {
+    if constexpr(isBitmap) {
+      auto const size = static_cast<size_t>(end - begin);
+      auto const bitsPerWord = size_t{BitIterator<true>::bitsPerWord};
+      auto words = std::vector<std::uint64_t>((size + bitsPerWord - 1) / bitsPerWord);
+      for(auto i = size_t{}; i < words.size(); i++) {
+        auto const offset = i * bitsPerWord;
+        words[i] = (begin + offset).loadWord(std::min(bitsPerWord, size - offset));
+      }
+      return Span<Target>::fromBitmap(std::move(words), size);
+    } else {
+      return Span<Target>(std::vector<std::remove_const_t<Scalar>>(begin, end));
+    }
+  }
+
+  template <typename Iterator> static Span packBits(Iterator begin, Iterator end) {
+    auto const size = static_cast<size_t>(std::distance(begin, end));
+    auto const bitsPerWord = size_t{BitIterator<true>::bitsPerWord};
+    auto words = std::vector<std::uint64_t>((size + bitsPerWord - 1) / bitsPerWord);
+    for(auto i = size_t{}; i < size; ++i, ++begin) {
+      words[i / bitsPerWord] |= static_cast<std::uint64_t>(bool(*begin)) << (i % bitsPerWord);
+    }
+    return fromBitmap(std::move(words), size);
+  }
+
+  static Span adopt(std::vector<std::remove_const_t<Scalar>>&& adaptee) {
+    if constexpr(isBitmap) {
+      return packBits(adaptee.begin(), adaptee.end());
+    } else {
+      auto* owner = new std::vector<std::remove_const_t<Scalar>>(std::move(adaptee)); // NOLINT
+      return Span(owner->data(), owner->size(), owner, &deleteAdaptee);
+    }
+  }
+
+  template <typename Vector> static Span borrow(Vector& adaptee) {
+    if constexpr(isBitmap) {
+      return packBits(adaptee.begin(), adaptee.end());
+    } else {
+      return Span(adaptee.data(), adaptee.size(), nullptr, nullptr);
+    }
+  }
+  static void callAndDeleteDestructor(void* destructor) {
+    auto* function = static_cast<std::function<void(void)>*>(destructor);
+    (*function)();
+    delete function; // NOLINT(cppcoreguidelines-owning-memory)
+  }
+
+  Span withValidity(std::unique_ptr<Span<bool>>&& validity) && {
+    this->validity = std::move(validity);
+    return std::move(*this);
+  }
+
+  Statistics* takeStatistics() const noexcept { return cachedStatistics.exchange(nullptr); }
+
+  void releaseOwner() noexcept {
+    if(release != nullptr) {
+      release(owner);
+    }
+    owner = nullptr;
+    release = nullptr;
+    shared = false;
+  }
 
 public: // surface
   using element_type = Scalar;
@@ -90,6 +589,17 @@ public: // surface
   constexpr Span<Scalar> subspan(size_t offset, size_t size) && {
     _begin += offset;
     _end = _begin + size;
+    if(validity) {
+      *validity = std::move(*validity).subspan(offset, size);
+    }
+    invalidateStatistics();
+    if constexpr(!isBitmap) {
+      auto const offsetInBytes = offset * sizeof(Scalar);
+      if(offsetInBytes % _alignment != 0) {
+        // the lowest set bit
+        _alignment = static_cast<std::uint32_t>(offsetInBytes & (~offsetInBytes + 1));
+      }
+    }
     return std::move(*this);
   }
 
@@ -98,48 +608,175 @@ public: // surface
   }
 
   /**
-   * The span takes ownership of the adaptee
+   * The span takes ownership of the adaptee (vectors of bools are packed into a new bitmap)
    */
   explicit Span(std::vector<std::remove_const_t<Scalar>>&& adaptee)
-      : _begin([&/* capturing context for immediate evaluation */]() {
-          if constexpr(std::is_same_v<Scalar, bool>) {
-            return adaptee.begin();
-          } else {
-            return adaptee.data();
-          }
-        }()),
-        _end(_begin + adaptee.size()), destructor([owner = std::move(adaptee)]() {}) {}
+      : Span(adopt(std::move(adaptee))) {}
 
   /**
    * The span does not take ownership of the adaptee. The vector better not be modified while the
-   * span lives
+   * span lives. Vectors of bools are the exception: their values are packed into a new (owned)
+   * bitmap, i.e., the span does not reflect modifications of the vector (and vice versa)
    */
-  explicit Span(std::vector<std::remove_const_t<Scalar>>& adaptee)
-      : _begin([&adaptee]() {
-          if constexpr(std::is_same_v<Scalar, bool>) {
-            return adaptee.begin();
-          } else {
-            return adaptee.data();
-          }
-        }()),
-        _end(_begin + adaptee.size()) {}
+  explicit Span(std::vector<std::remove_const_t<Scalar>>& adaptee) : Span(borrow(adaptee)) {}
 
   /**
    * The span does not take ownership of the adaptee. The vector better not be modified while the
-   * span lives
+   * span lives (see above for vectors of bools)
    */
   explicit Span(std::vector<std::remove_const_t<Scalar>> const& adaptee)
-      : _begin([&adaptee]() {
-          if constexpr(std::is_same_v<Scalar, bool>) {
-            return adaptee.begin();
-          } else {
-            return adaptee.data();
-          }
-        }()),
-        _end(_begin + adaptee.size()) {}
+      : Span(borrow(adaptee)) {}
+
+  /**
+   * The span takes ownership of a packed bitmap holding size bools
+   */
+  static Span fromBitmap(std::vector<std::uint64_t>&& words, size_t size) {
+    static_assert(isBitmap, "only spans of bools are bitmaps");
+    auto* owner = new std::vector<std::uint64_t>(std::move(words)); // NOLINT
+    return Span(IteratorType(owner->data(), 0), size, owner, &deleteWords);
+  }
+
+  static constexpr size_t cacheLineSize = 64;
+
+  /**
+   * Allocates a span of size zero-initialized values for vectorized kernels: the first value is
+   * aligned to Alignment bytes and the buffer is zero-padded to a multiple of Alignment bytes,
+   * i.e., kernels can process it in full (aligned) vectors without peeling the head or the tail
+   */
+  template <size_t Alignment = cacheLineSize> static Span allocateAligned(size_t size) {
+    static_assert(std::is_arithmetic_v<Scalar> && !isBitmap,
+                  "only spans of numeric values can be allocated aligned");
+    static_assert((Alignment & (Alignment - 1)) == 0 && Alignment % alignof(Scalar) == 0,
+                  "the alignment must be a power of two (and a multiple of the value alignment)");
+    auto const bytes = std::max((size * sizeof(Scalar) + Alignment - 1) / Alignment * Alignment,
+                                Alignment);
+    auto* buffer = ::operator new(bytes, std::align_val_t{Alignment});
+    std::memset(buffer, 0, bytes);
+    auto result = Span(static_cast<Scalar*>(buffer), size, buffer, &releaseAligned<Alignment>);
+    result._alignment = Alignment;
+    return result;
+  }
+
+  /**
+   * The (guaranteed) alignment of begin() in bytes. The memory up to end(), rounded up to the next
+   * multiple of the alignment, is readable (see allocateAligned). Spans of other origins are only
+   * aligned to their values (and subspans inherit the alignment their offset allows)
+   */
+  size_t alignment() const { return _alignment; }
+
+  /**
+   * Word-level access to the bitmap of a span of bools: the first value of the span is bit
+   * bitOffset() (counting from the least significant bit) of words()[0]. Bits outside of the span
+   * are unspecified
+   */
+  auto words() const {
+    static_assert(isBitmap, "only spans of bools are bitmaps");
+    return _begin.word();
+  }
+  size_t bitOffset() const {
+    static_assert(isBitmap, "only spans of bools are bitmaps");
+    return _begin.bit();
+  }
+
+  /**
+   * Attaches a validity bitmap (one bit per value, zero for null values) to the span which makes
+   * it nullable. The bitmap is carried through moves, subspans, clones and shares. The values at
+   * null positions are unspecified (but must be readable so kernels can process them branch-free)
+   */
+  Span withValidity(Span<bool>&& validity) && {
+    if(validity.size() != size()) {
+      throw std::invalid_argument("validity bitmap of size " + std::to_string(validity.size()) +
+                                  " does not match span of size " + std::to_string(size()));
+    }
+    this->validity = std::make_unique<Span<bool>>(std::move(validity));
+    invalidateStatistics();
+    return std::move(*this);
+  }
+
+  bool isNullable() const { return bool(validity); }
+  /**
+   * The validity bitmap (nullptr for spans without null values)
+   */
+  Span<bool> const* getValidity() const { return validity.get(); }
+  Span<bool>* getValidity() { return validity.get(); }
+  bool isValid(size_t index) const { return !validity || (*validity)[index]; }
+
+  /**
+   * The statistics of the values (min, max, null count, sortedness and an estimate of the number
+   * of distinct values). They are computed (in a single pass) on first access and cached in the
+   * span, so all engines in a pipeline share the cost. Spans cannot track writes through iterators
+   * or references: whoever modifies the values of a span must call invalidateStatistics()
+   * (makeWritable() and subspan() do so implicitly). Concurrent first accesses are safe (one of
+   * the computed results is kept)
+   */
+  Statistics const& statistics() const {
+    static_assert((std::is_arithmetic_v<Scalar> && !isBitmap) ||
+                      std::is_same_v<std::remove_const_t<Scalar>, std::string>,
+                  "statistics are only computed for spans of numbers or strings");
+    if(auto const* statistics = cachedStatistics.load(std::memory_order_acquire)) {
+      return *statistics;
+    }
+    auto* computed = new Statistics(computeStatistics()); // NOLINT(cppcoreguidelines-owning-memory)
+    auto* expected = static_cast<Statistics*>(nullptr);
+    if(!cachedStatistics.compare_exchange_strong(expected, computed, std::memory_order_acq_rel)) {
+      delete computed; // NOLINT(cppcoreguidelines-owning-memory)
+      return *expected;
+    }
+    return *computed;
+  }
+  bool hasStatistics() const { return cachedStatistics.load(std::memory_order_acquire) != nullptr; }
+  void invalidateStatistics() const {
+    delete takeStatistics(); // NOLINT(cppcoreguidelines-owning-memory)
+  }
+
+private:
+  Statistics computeStatistics() const {
+    auto result = Statistics();
+    auto distinctValues = DistinctCountEstimator();
+    Scalar const* previous = nullptr;
+    for(auto i = size_t{}; i < size(); i++) {
+      if(!isValid(i)) {
+        result.nullCount++;
+        continue;
+      }
+      auto const& value = (*this)[i];
+      if(previous == nullptr) {
+        result.min = value;
+        result.max = value;
+      } else {
+        result.sorted = result.sorted && !(value < *previous);
+        if(value < *result.min) {
+          result.min = value;
+        }
+        if(*result.max < value) {
+          result.max = value;
+        }
+      }
+      distinctValues.add(std::hash<std::remove_const_t<Scalar>>{}(value));
+      previous = &value;
+    }
+    result.distinctCount = distinctValues.estimate();
+    return result;
+  }
+
+public:
 
   explicit Span(IteratorType begin, size_t size, std::function<void(void)> destructor)
-      : _begin(begin), _end(begin + size), destructor(std::move(destructor)) {}
+      : _begin(begin), _end(begin + size),
+        owner(destructor ? new std::function<void(void)>(std::move(destructor)) : nullptr),
+        release(owner != nullptr ? &callAndDeleteDestructor : nullptr) {}
+
+  /**
+   * The span takes ownership of the owner: release(owner) is called once the span (or the last
+   * span sharing it) is destroyed. This is compatible with C-style release callbacks and does not
+   * allocate. Non-owning spans pass neither an owner nor a release function
+   */
+  explicit Span(IteratorType begin, size_t size, void* owner, void (*release)(void*))
+      : _begin(begin), _end(begin + size), owner(owner), release(release) {
+    if(owner != nullptr && release == nullptr) {
+      throw std::invalid_argument("a span with an owner needs a release function");
+    }
+  }
 
   bool operator==(Span const& other) const { return _begin == other._begin; }
 
@@ -151,8 +788,12 @@ public: // surface
    */
   Span(Span const& other) = delete;
   Span(Span&& other) noexcept
-      : _begin(other._begin), _end(other._end), destructor(std::move(other.destructor)) {
-    other.destructor = nullptr;
+      : _begin(other._begin), _end(other._end), owner(other.owner), release(other.release),
+        _alignment(other._alignment), shared(other.shared), validity(std::move(other.validity)),
+        cachedStatistics(other.takeStatistics()) {
+    other.owner = nullptr;
+    other.release = nullptr;
+    other.shared = false;
   };
 
   /**
@@ -160,18 +801,109 @@ public: // surface
    * values in the other Span, arguments are copied into a std::vector. The alternative would be
    * to use some kind of reference chain or counting but I (Holger) did not like that -- I am open
    * to discussing this, though
+   *
+   * Spans that have been shared (see share()) are the exception: their clones reference the same
+   * buffer and are, thus, O(1)
    */
   template <typename... Reason> Span<std::remove_const_t<Scalar>> clone(Reason... reason) const& {
     checkCloneWithoutReason(reason...);
-    return Span<std::remove_const_t<Scalar>>(
-        std::vector<std::remove_const_t<Scalar>>(_begin, _end));
+    auto result = isShared() ? Span<std::remove_const_t<Scalar>>(
+                                   withoutConst(_begin), withoutConst(_end),
+                                   static_cast<SharedSpanOwner*>(owner), _alignment)
+                             : copyOf<std::remove_const_t<Scalar>>(_begin, _end);
+    if(validity) {
+      result.validity = std::make_unique<Span<bool>>(validity->clone(reason...));
+    }
+    if(auto const* statistics = cachedStatistics.load(std::memory_order_acquire)) {
+      // NOLINTNEXTLINE(cppcoreguidelines-owning-memory)
+      result.cachedStatistics = new Statistics(*statistics);
+    }
+    return result;
+  }
+
+  /**
+   * Turns the span into one that shares ownership of its buffer so that cloning it does not copy
+   * the values. The ownership of an owning span is transferred to a reference count (no copy),
+   * the values of a non-owning span are copied (once) because the span cannot extend the lifetime
+   * of the adaptee. The buffer of a shared span must be treated as immutable: use makeWritable()
+   * before modifying values
+   */
+  Span share() && {
+    if(validity) {
+      *validity = std::move(*validity).share();
+    }
+    if(isShared()) {
+      return std::move(*this);
+    }
+    if(release == nullptr) {
+      return copyOf<Scalar>(_begin, _end).share().withValidity(std::move(validity));
+    }
+    owner = new SharedSpanOwner(owner, release); // NOLINT(cppcoreguidelines-owning-memory)
+    release = &SharedSpanOwner::releaseShared;
+    shared = true;
+    return std::move(*this);
+  }
+
+  bool isShared() const { return shared; }
+
+  /**
+   * the bytes of the values (and of the validity bitmap) by ownership, see MemoryFootprint. Shared
+   * buffers that are in counted already are skipped (and the others added to it)
+   */
+  MemoryFootprint footprint(SharedBuffers* counted = nullptr) const {
+    auto bytes = size_t{};
+    if constexpr(isBitmap) {
+      bytes = (size() + 63) / 64 * sizeof(std::uint64_t); // NOLINT(*-magic-numbers)
+    } else {
+      bytes = size() * sizeof(Scalar);
+      if constexpr(std::is_same_v<std::remove_const_t<Scalar>, std::string>) {
+        for(auto const& string : *this) {
+          bytes += allocatedBytes(string);
+        }
+      }
+    }
+    auto result = MemoryFootprint{};
+    if(isShared() && counted != nullptr && !counted->insert(owner).second) {
+      bytes = 0;
+    }
+    (isShared() ? result.shared : release != nullptr ? result.owned : result.borrowed) = bytes;
+    if(validity) {
+      result += validity->footprint(counted);
+    }
+    return result;
+  }
+
+  /**
+   * The copy-on-write path for shared spans: if the buffer is referenced by other spans, the values
+   * are copied into a buffer that is exclusively owned by this span
+   */
+  Span& makeWritable() & {
+    static_assert(!std::is_const_v<Scalar>, "spans of const values cannot be made writable");
+    if(isShared() && !static_cast<SharedSpanOwner*>(owner)->isExclusive()) {
+      *this = copyOf<Scalar>(_begin, _end).share().withValidity(std::move(validity));
+    }
+    if(validity) {
+      validity->makeWritable();
+    }
+    invalidateStatistics();
+    return *this;
   }
 
   Span& operator=(Span&& other) noexcept {
-    _begin = (other._begin);
-    _end = (other._end);
-    destructor = (std::move(other.destructor));
-    other.destructor = nullptr;
+    if(this != &other) {
+      releaseOwner();
+      _begin = (other._begin);
+      _end = (other._end);
+      owner = other.owner;
+      release = other.release;
+      _alignment = other._alignment;
+      shared = other.shared;
+      validity = std::move(other.validity);
+      delete cachedStatistics.exchange(other.takeStatistics()); // NOLINT
+      other.owner = nullptr;
+      other.release = nullptr;
+      other.shared = false;
+    }
     return *this;
   };
 
@@ -182,9 +914,8 @@ public: // surface
   // NOLINTBEGIN(bugprone-exception-escape)
 
   ~Span() {
-    if(destructor) {
-      destructor();
-    }
+    releaseOwner();
+    invalidateStatistics();
   };
   // NOLINTEND(bugprone-exception-escape)
 
@@ -192,10 +923,399 @@ public: // surface
     return stream << span.size;
   }
 };
+
+/**
+ * A span of strings in the Arrow layout: the characters of all strings are stored in one contiguous
+ * buffer and string i is made up of the characters [offsets[i], offsets[i + 1]). This avoids a
+ * string object (and, potentially, an allocation) per value and lets scans stream through memory.
+ * Values are accessed as string_views (which are only valid as long as the span is)
+ */
+class StringSpan {
+  Span<std::int64_t> offsets;
+  Span<char> characters;
+
+public:
+  using element_type = std::string_view;
+
+  StringSpan() noexcept = default;
+  /**
+   * The span takes ownership of the offsets (one more than there are strings) and characters
+   */
+  StringSpan(Span<std::int64_t>&& offsets, Span<char>&& characters) noexcept
+      : offsets(std::move(offsets)), characters(std::move(characters)) {}
+
+  /**
+   * The values are copied
+   */
+  explicit StringSpan(std::vector<std::string> const& strings) {
+    auto offsetsVector = std::vector<std::int64_t>();
+    offsetsVector.reserve(strings.size() + 1);
+    offsetsVector.push_back(0);
+    for(auto const& string : strings) {
+      offsetsVector.push_back(offsetsVector.back() + static_cast<std::int64_t>(string.size()));
+    }
+    auto charactersVector = std::vector<char>();
+    charactersVector.reserve(offsetsVector.back());
+    for(auto const& string : strings) {
+      charactersVector.insert(charactersVector.end(), string.begin(), string.end());
+    }
+    offsets = Span<std::int64_t>(std::move(offsetsVector));
+    characters = Span<char>(std::move(charactersVector));
+  }
+
+  size_t size() const { return offsets.size() == 0 ? 0 : offsets.size() - 1; }
+  std::string_view operator[](size_t index) const {
+    return {characters.begin() + offsets[index],
+            static_cast<size_t>(offsets[index + 1] - offsets[index])};
+  }
+  std::string_view at(size_t index) const {
+    if(index < size()) {
+      return (*this)[index];
+    }
+    throw std::out_of_range("StringSpan has no element with index " + std::to_string(index));
+  }
+
+  /**
+   * raw access for kernels that stream through the strings (note that the offsets of a subspan
+   * do not start at zero)
+   */
+  Span<std::int64_t> const& getOffsets() const { return offsets; }
+  Span<char> const& getCharacters() const { return characters; }
+
+  /**
+   * O(1): the characters are shared with the original span
+   */
+  StringSpan subspan(size_t offset, size_t size) && {
+    return {std::move(offsets).subspan(offset, size + 1), std::move(characters)};
+  }
+  StringSpan subspan(size_t offset) && {
+    auto const remaining = size() - offset;
+    return std::move(*this).subspan(offset, remaining);
+  }
+
+  template <typename... Reason> StringSpan clone(Reason... reason) const& {
+    return {offsets.clone(reason...), characters.clone(reason...)};
+  }
+  StringSpan share() && { return {std::move(offsets).share(), std::move(characters).share()}; }
+  /**
+   * copies the offsets and characters if they are referenced by other spans (see
+   * Span::makeWritable)
+   */
+  StringSpan& makeWritable() & {
+    offsets.makeWritable();
+    characters.makeWritable();
+    return *this;
+  }
+  MemoryFootprint footprint(SharedBuffers* counted = nullptr) const {
+    return offsets.footprint(counted) + characters.footprint(counted);
+  }
+
+  bool operator==(StringSpan const& other) const {
+    return offsets == other.offsets && characters == other.characters;
+  }
+
+  friend std::ostream& operator<<(std::ostream& stream, StringSpan const& span) {
+    return stream << span.size();
+  }
+};
+
+/**
+ * A dictionary-encoded span for columns with few distinct values (e.g., flags, statuses or
+ * segments): every value is stored as a 32-bit code into a dictionary of the distinct values. The
+ * dictionary is immutable and shared (by clones, subspans and all spans encoded with it), so
+ * engines can evaluate equality predicates and group-bys on the codes (see codeOf) and only decode
+ * the values they output. Values are read-only
+ */
+template <typename Value> class DictionarySpan {
+public:
+  using Code = std::int32_t;
+  using Dictionary = std::vector<Value>;
+
+private:
+  Span<Code> codes;
+  std::shared_ptr<Dictionary const> dictionary = std::make_shared<Dictionary const>();
+
+public:
+  using element_type = Value const;
+
+  DictionarySpan() noexcept = default;
+  /**
+   * The span takes ownership of the codes, each of which has to be a valid index into the
+   * dictionary
+   */
+  DictionarySpan(Span<Code>&& codes, std::shared_ptr<Dictionary const> dictionary) noexcept
+      : codes(std::move(codes)), dictionary(std::move(dictionary)) {}
+
+  /**
+   * Encodes the values, assigning codes to the distinct values in the order of their first
+   * occurrence
+   */
+  static DictionarySpan encode(std::vector<Value> const& values) {
+    auto distinctValues = Dictionary();
+    auto codesOfValues = std::unordered_map<Value, Code>();
+    auto encoded = std::vector<Code>();
+    encoded.reserve(values.size());
+    for(auto const& value : values) {
+      auto [it, inserted] =
+          codesOfValues.try_emplace(value, static_cast<Code>(distinctValues.size()));
+      if(inserted) {
+        distinctValues.push_back(value);
+      }
+      encoded.push_back(it->second);
+    }
+    return {Span<Code>(std::move(encoded)),
+            std::make_shared<Dictionary const>(std::move(distinctValues))};
+  }
+
+  size_t size() const { return codes.size(); }
+  Value const& operator[](size_t index) const { return (*dictionary)[codes[index]]; }
+  Value const& at(size_t index) const {
+    if(index < size()) {
+      return (*this)[index];
+    }
+    throw std::out_of_range("DictionarySpan has no element with index " + std::to_string(index));
+  }
+
+  Span<Code> const& getCodes() const { return codes; }
+  std::shared_ptr<Dictionary const> const& getDictionary() const { return dictionary; }
+
+  /**
+   * the dictionary is accounted for as shared (it is referenced by all spans encoded with it)
+   */
+  MemoryFootprint footprint(SharedBuffers* counted = nullptr) const {
+    auto result = codes.footprint(counted);
+    if(counted != nullptr && !counted->insert(dictionary.get()).second) {
+      return result;
+    }
+    result.shared += dictionary->capacity() * sizeof(Value);
+    if constexpr(std::is_same_v<Value, std::string>) {
+      for(auto const& value : *dictionary) {
+        result.shared += allocatedBytes(value);
+      }
+    }
+    return result;
+  }
+
+  /**
+   * the code of value (if value is in the dictionary), e.g., to turn a comparison with a constant
+   * into a comparison of codes
+   */
+  std::optional<Code> codeOf(Value const& value) const {
+    auto const it = std::find(dictionary->begin(), dictionary->end(), value);
+    if(it == dictionary->end()) {
+      return {};
+    }
+    return static_cast<Code>(it - dictionary->begin());
+  }
+
+  /**
+   * materializes the values
+   */
+  Span<Value> decode() const {
+    auto values = std::vector<Value>();
+    values.reserve(size());
+    for(auto i = 0U; i < size(); i++) {
+      values.push_back((*this)[i]);
+    }
+    return Span<Value>(std::move(values));
+  }
+
+  /**
+   * O(1): the subspan shares the codes and the dictionary with the original span
+   */
+  DictionarySpan subspan(size_t offset, size_t size) && {
+    return {std::move(codes).subspan(offset, size), std::move(dictionary)};
+  }
+  DictionarySpan subspan(size_t offset) && {
+    auto const remaining = size() - offset;
+    return std::move(*this).subspan(offset, remaining);
+  }
+
+  template <typename... Reason> DictionarySpan clone(Reason... reason) const& {
+    return {codes.clone(reason...), dictionary};
+  }
+  DictionarySpan share() && { return {std::move(codes).share(), std::move(dictionary)}; }
+  /**
+   * copies the codes if they are referenced by other spans (see Span::makeWritable). The
+   * dictionary is immutable and stays shared
+   */
+  DictionarySpan& makeWritable() & {
+    codes.makeWritable();
+    return *this;
+  }
+
+  bool operator==(DictionarySpan const& other) const {
+    return codes == other.codes && dictionary == other.dictionary;
+  }
+
+  friend std::ostream& operator<<(std::ostream& stream, DictionarySpan const& span) {
+    return stream << span.size();
+  }
+};
 } // namespace atoms
+using atoms::BitReference;
+using atoms::ConstBitReference;
+using atoms::DictionarySpan;
 using atoms::Span;
+using atoms::StringSpan;
 using atoms::Symbol;
 
+/**
+ * Structural hashing of expressions. The hash of a complex expression combines the hash of its head
+ * with the hashes of its arguments and their positions -- arguments are hashed by value, no matter
+ * whether they are static, dynamic or span arguments, so that expressions that compare equal hash
+ * equally. For the same reason, numbers are hashed by value (1, 1L and 1.0 have the same hash)
+ */
+namespace hashing {
+// NOLINTBEGIN(readability-magic-numbers)
+inline constexpr std::uint64_t mix(std::uint64_t hash) noexcept {
+  hash = (hash ^ (hash >> 30U)) * 0xbf58476d1ce4e5b9ULL;
+  hash = (hash ^ (hash >> 27U)) * 0x94d049bb133111ebULL;
+  return hash ^ (hash >> 31U);
+}
+inline constexpr auto stringTag = std::uint64_t{0x5f2c6d1a3b8e9047ULL};
+inline constexpr auto symbolTag = std::uint64_t{0x9a1d47e3c26b5f08ULL};
+inline constexpr auto complexTag = std::uint64_t{0x3c7e0b59d4a8f216ULL};
+inline constexpr auto otherTag = std::uint64_t{0xe4b95a0c17f3d682ULL};
+/**
+ * the hash of the argument with the given hash at the given position (these are summed up, which
+ * keeps the loops over span values free of dependencies)
+ */
+inline constexpr std::uint64_t atPosition(std::uint64_t hash, size_t position) noexcept {
+  return mix(hash + position * 0x9e3779b97f4a7c15ULL);
+}
+// NOLINTEND(readability-magic-numbers)
+
+template <typename T, typename = void> struct isHashable : std::false_type {};
+template <typename T>
+struct isHashable<T, std::void_t<decltype(std::hash<T>{}(std::declval<T const&>()))>>
+    : std::true_type {};
+
+template <typename T> std::uint64_t hashAtom(T const& value) {
+  if constexpr(std::is_same_v<T, bool>) {
+    return value ? 1 : 0;
+  } else if constexpr(std::is_integral_v<T>) {
+    return static_cast<std::uint64_t>(static_cast<std::int64_t>(value));
+  } else if constexpr(std::is_floating_point_v<T>) {
+    auto const asDouble = static_cast<double>(value);
+    // NOLINTNEXTLINE(readability-magic-numbers)
+    if(std::trunc(asDouble) == asDouble && std::abs(asDouble) < 0x1p63) {
+      return static_cast<std::uint64_t>(static_cast<std::int64_t>(asDouble));
+    }
+    auto bits = std::uint64_t{};
+    std::memcpy(&bits, &asDouble, sizeof(bits));
+    return bits;
+  } else if constexpr(std::is_convertible_v<T const&, std::string_view>) {
+    return atoms::hashSymbolName(value) ^ stringTag;
+  } else if constexpr(std::is_same_v<T, Symbol>) {
+    return value.getHash() ^ symbolTag;
+  } else if constexpr(isHashable<T>::value) {
+    return std::hash<T>{}(value) ^ otherTag;
+  } else {
+    return otherTag;
+  }
+}
+
+/**
+ * the sum of the (positional) hashes of the values of a span, the first one being at position
+ * firstPosition. The values of numeric spans are hashed in a plain loop which compilers vectorize
+ */
+template <typename SpanType>
+std::uint64_t hashSpan(SpanType const& span, size_t firstPosition) {
+  auto result = std::uint64_t{};
+  if constexpr(boss::utilities::isInstanceOfTemplate<SpanType, Span>::value) {
+    using Value = std::remove_const_t<typename std::iterator_traits<
+        std::remove_cv_t<decltype(span.begin())>>::value_type>;
+    if constexpr(std::is_same_v<Value, bool>) {
+      for(auto i = size_t{}; i < span.size(); i++) {
+        result += atPosition(hashAtom(static_cast<bool>(span[i])), firstPosition + i);
+      }
+    } else {
+      auto const* values = span.begin();
+      for(auto i = size_t{}; i < span.size(); i++) {
+        result += atPosition(hashAtom(values[i]), firstPosition + i);
+      }
+    }
+  } else if constexpr(boss::utilities::isInstanceOfTemplate<SpanType, DictionarySpan>::value) {
+    // the dictionary is hashed once, the values are hashed by looking up their codes
+    auto const& dictionary = *span.getDictionary();
+    auto dictionaryHashes = std::vector<std::uint64_t>(dictionary.size());
+    std::transform(dictionary.begin(), dictionary.end(), dictionaryHashes.begin(),
+                   [](auto const& value) { return hashAtom(value); });
+    auto const& codes = span.getCodes();
+    for(auto i = size_t{}; i < span.size(); i++) {
+      result += atPosition(dictionaryHashes[codes[i]], firstPosition + i);
+    }
+  } else {
+    for(auto i = size_t{}; i < span.size(); i++) {
+      result += atPosition(hashAtom(span[i]), firstPosition + i);
+    }
+  }
+  return result;
+}
+
+/**
+ * true if the spans hold the same values. Spans of integers are compared with memcmp (not
+ * floating-point ones: 0.0 equals -0.0 and NaN does not equal itself), dictionary-encoded spans
+ * sharing a dictionary by their codes
+ */
+template <typename SpanType> bool spanValuesEqual(SpanType const& span, SpanType const& other) {
+  if(span.size() != other.size()) {
+    return false;
+  }
+  if constexpr(boss::utilities::isInstanceOfTemplate<SpanType, Span>::value) {
+    using Value = std::remove_const_t<typename std::iterator_traits<
+        std::remove_cv_t<decltype(span.begin())>>::value_type>;
+    if constexpr(std::is_integral_v<Value> && !std::is_same_v<Value, bool>) {
+      return span.size() == 0 || span.begin() == other.begin() ||
+             std::memcmp(span.begin(), other.begin(), span.size() * sizeof(Value)) == 0;
+    } else if constexpr(!std::is_same_v<Value, bool>) {
+      return std::equal(span.begin(), span.end(), other.begin());
+    }
+  } else if constexpr(boss::utilities::isInstanceOfTemplate<SpanType, DictionarySpan>::value) {
+    if(span.getDictionary() == other.getDictionary()) {
+      return spanValuesEqual(span.getCodes(), other.getCodes());
+    }
+  }
+  for(auto i = size_t{}; i < span.size(); i++) {
+    if(!(span[i] == other[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * Accumulates the structural hash of a complex expression (or of anything that materializes into
+ * one, e.g., a SharedExpressionNode): the arguments are added in order, followed by the spans, and
+ * the head is mixed in last
+ */
+class Accumulator {
+  std::uint64_t argumentsHash = 0;
+  size_t position = 0;
+
+public:
+  /**
+   * the position of the next argument
+   */
+  size_t nextPosition() const { return position; }
+  /**
+   * adds an argument by its hash (see hashAtom and addComplex)
+   */
+  void add(std::uint64_t argumentHash) { argumentsHash += atPosition(argumentHash, position++); }
+  template <typename T> void addAtom(T const& atom) { add(hashAtom(atom)); }
+  void addComplex(std::uint64_t complexHash) { add(complexHash ^ complexTag); }
+  template <typename SpanType> void addSpan(SpanType const& span) {
+    argumentsHash += hashSpan(span, position);
+    position += span.size();
+  }
+  std::uint64_t finish(Symbol const& head) const {
+    auto const result = mix(argumentsHash ^ mix(head.getHash() + position));
+    return result == 0 ? 1 : result; // zero marks a hash that has not been computed
+  }
+};
+} // namespace hashing
+
 template <typename TargetType> class ArgumentTypeMismatch;
 template <> class ArgumentTypeMismatch<void> : public ::std::bad_variant_access {
 private:
@@ -356,10 +1476,10 @@ public:
 
 template <typename... AdditionalCustomAtoms>
 class ExpressionArgumentsWithAdditionalCustomAtoms
-    : public std::vector<ExpressionWithAdditionalCustomAtoms<AdditionalCustomAtoms...>> {
+    : public std::pmr::vector<ExpressionWithAdditionalCustomAtoms<AdditionalCustomAtoms...>> {
 public:
   ExpressionArgumentsWithAdditionalCustomAtoms() = default;
-  using std::vector<ExpressionWithAdditionalCustomAtoms<AdditionalCustomAtoms...>>::vector;
+  using std::pmr::vector<ExpressionWithAdditionalCustomAtoms<AdditionalCustomAtoms...>>::vector;
 
   template <typename... ArgType,
             std::enable_if_t<(std::is_convertible_v<ArgType, ExpressionWithAdditionalCustomAtoms<
@@ -367,8 +1487,8 @@ public:
                               ...),
                              bool> = false>
   explicit ExpressionArgumentsWithAdditionalCustomAtoms(ArgType&&... arg) {
-
-    (std::vector<ExpressionWithAdditionalCustomAtoms<AdditionalCustomAtoms...>>::emplace_back(
+    this->reserve(sizeof...(ArgType));
+    (std::pmr::vector<ExpressionWithAdditionalCustomAtoms<AdditionalCustomAtoms...>>::emplace_back(
          std::move(arg)),
      ...);
   }
@@ -381,14 +1501,15 @@ using ExpressionSpanArgumentWithAdditionalCustomAtoms =
                  Span<AdditionalCustomAtoms>..., Span<bool const>, Span<std::int8_t const>,
                  Span<std::int32_t const>, Span<std::int64_t const>, Span<std::float_t const>,
                  Span<std::double_t const>, Span<std::string const>, Span<Symbol const>,
-                 Span<AdditionalCustomAtoms const>...>;
+                 Span<AdditionalCustomAtoms const>..., StringSpan, DictionarySpan<std::string>,
+                 DictionarySpan<Symbol>>;
 
 template <typename... AdditionalCustomAtoms>
 class ExpressionSpanArgumentsWithAdditionalCustomAtoms
-    : public std::vector<
+    : public std::pmr::vector<
           ExpressionSpanArgumentWithAdditionalCustomAtoms<AdditionalCustomAtoms...>> {
 public:
-  using std::vector<
+  using std::pmr::vector<
       ExpressionSpanArgumentWithAdditionalCustomAtoms<AdditionalCustomAtoms...>>::vector;
 
   template <typename... ArgType,
@@ -399,7 +1520,7 @@ public:
                 bool> = false>
   explicit ExpressionSpanArgumentsWithAdditionalCustomAtoms(ArgType&&... arg) {
 
-    (std::vector<ExpressionSpanArgumentWithAdditionalCustomAtoms<AdditionalCustomAtoms...>>::
+    (std::pmr::vector<ExpressionSpanArgumentWithAdditionalCustomAtoms<AdditionalCustomAtoms...>>::
          emplace_back(std::move(arg)),
      ...);
   }
@@ -477,7 +1598,7 @@ using ArgumentWrappeeType = typename boss::utilities::variant_amend<
     typename boss::utilities::rewrap_variant_arguments<
         MovableReferenceWrapper,
         AtomicExpressionWithAdditionalCustomAtoms<AdditionalCustomAtoms...>>::type,
-    std::vector<bool>::reference,
+    BitReference, std::string_view,
     MovableReferenceWrapper<ExpressionWithAdditionalCustomAtoms<AdditionalCustomAtoms...>>>::type;
 
 template <typename... AdditionalCustomAtoms>
@@ -486,7 +1607,7 @@ using ConstArgumentWrappeeType = typename boss::utilities::variant_amend<
         MovableReferenceWrapper,
         typename utilities::make_variant_members_const<
             AtomicExpressionWithAdditionalCustomAtoms<AdditionalCustomAtoms...>>::type>::type,
-    std::vector<bool>::const_reference,
+    ConstBitReference, std::string_view,
     MovableReferenceWrapper<ExpressionWithAdditionalCustomAtoms<AdditionalCustomAtoms...> const>>::
     type;
 
@@ -536,10 +1657,13 @@ public:
             return std::forward<decltype(expression)>(expression).get();
           } else if constexpr(::std::disjunction_v<
                                   ::std::is_same<::std::decay_t<decltype(expression)>,
-                                                 ::std::vector<bool>::reference>,
+                                                 BitReference>,
                                   ::std::is_same<::std::decay_t<decltype(expression)>,
-                                                 ::std::vector<bool>::const_reference>>) {
+                                                 ConstBitReference>>) {
             return (bool)expression;
+          } else if constexpr(::std::is_same_v<::std::decay_t<decltype(expression)>,
+                                               ::std::string_view>) {
+            return ::std::string(expression);
           } else {
             return std::forward<decltype(expression)>(expression);
           }
@@ -568,14 +1692,17 @@ public:
       : argument(MovableReferenceWrapper(std::cref(argument))) {}
 
   template <typename T, typename = std::enable_if_t<
-                            std::disjunction_v<std::is_same<T, std::vector<bool>::const_reference>,
-                                               std::is_same<T, std::vector<bool>::reference>>>>
+                            std::disjunction_v<std::is_same<T, ConstBitReference>,
+                                               std::is_same<T, BitReference>,
+                                               std::is_same<T, std::string_view>>>>
   ArgumentWrapper(T&& argument) // NOLINT(hicpp-explicit-conversions)
       : argument([&argument]() {
-          if constexpr(ConstWrappee || std::is_same_v<T, std::vector<bool>::const_reference>) {
-            return static_cast<std::vector<bool>::const_reference>(argument);
+          if constexpr(std::is_same_v<T, std::string_view>) {
+            return argument;
+          } else if constexpr(ConstWrappee || std::is_same_v<T, ConstBitReference>) {
+            return static_cast<ConstBitReference>(argument);
           } else {
-            return static_cast<std::vector<bool>::reference>(argument);
+            return static_cast<BitReference>(argument);
           }
         }()) {}
 
@@ -607,6 +1734,9 @@ public:
                                   std::decay_t<decltype(typedArg)>,
                                   MovableReferenceWrapper>::value) {
             return unwrap(typedArg.get());
+          } else if constexpr(std::is_same_v<std::decay_t<decltype(typedArg)>, std::string_view>) {
+            return ExpressionWithAdditionalCustomAtoms<AdditionalCustomAtoms...>(
+                std::string(typedArg));
           } else {
             return ExpressionWithAdditionalCustomAtoms<AdditionalCustomAtoms...>(typedArg);
           }
@@ -632,10 +1762,12 @@ public:
     return visit(
         [&stream](auto&& val) -> auto& {
           if constexpr(::std::disjunction_v<::std::is_same<::std::decay_t<decltype(val)>,
-                                                           ::std::vector<bool>::reference>,
+                                                           BitReference>,
                                             ::std::is_same<::std::decay_t<decltype(val)>,
-                                                           ::std::vector<bool>::const_reference>>) {
+                                                           ConstBitReference>>) {
             return stream << (bool)val;
+          } else if constexpr(::std::is_same_v<::std::decay_t<decltype(val)>, ::std::string_view>) {
+            return stream << val;
           } else {
             return stream << val.get();
           }
@@ -644,6 +1776,40 @@ public:
   }
 };
 
+namespace detail {
+/**
+ * probes whether a visitor has a dedicated (non-template) overload for std::string_view: the probe
+ * adds a non-template fallback which wins against generic overloads (without instantiating them)
+ * but is ambiguous with a dedicated string_view overload
+ */
+struct StringViewFallback {
+  StringViewFallback operator()(::std::string_view /*unused*/) const;
+};
+template <typename Func, typename = void> struct StringViewProbe : StringViewFallback {};
+template <typename Func>
+struct StringViewProbe<Func,
+                       ::std::enable_if_t<::std::is_class_v<Func> && !::std::is_final_v<Func>>>
+    : Func, StringViewFallback {
+  using Func::operator();
+  using StringViewFallback::operator();
+};
+template <typename Func>
+constexpr bool acceptsStringView =
+    !::std::is_invocable_v<StringViewProbe<::std::decay_t<Func>>&, ::std::string_view>;
+} // namespace detail
+
+/**
+ * Values of string spans are passed as string_views (without copying) to visitors with a dedicated
+ * string_view overload and as strings (like all other string arguments) to all other visitors
+ */
+template <typename Func> decltype(auto) visitStringView(Func&& func, ::std::string_view value) {
+  if constexpr(detail::acceptsStringView<Func>) {
+    return ::std::forward<Func>(func)(value);
+  } else {
+    return ::std::forward<Func>(func)(::std::string(value));
+  }
+}
+
 template <typename Func, auto ConstWrappee, typename... AdditionalCustomAtoms>
 decltype(auto) visit(Func&& func,
                      ArgumentWrapper<ConstWrappee, AdditionalCustomAtoms...> const& wrapper) {
@@ -662,6 +1828,9 @@ decltype(auto) visit(Func&& func,
                                 ::std::remove_cv_t<::std::remove_reference_t<decltype(unwrapped)>>,
                                 ExpressionWithAdditionalCustomAtoms<AdditionalCustomAtoms...>>) {
           return visit(::std::forward<Func>(func), unwrapped);
+        } else if constexpr(::std::is_same_v<::std::decay_t<decltype(unwrapped)>,
+                                             ::std::string_view>) {
+          return visitStringView(::std::forward<Func>(func), unwrapped);
         } else {
           return ::std::forward<Func>(func)(unwrapped);
         }
@@ -687,6 +1856,9 @@ decltype(auto) visit(Func&& func,
                                 ::std::remove_cv_t<::std::remove_reference_t<decltype(unwrapped)>>,
                                 ExpressionWithAdditionalCustomAtoms<AdditionalCustomAtoms...>>) {
           return visit(::std::forward<Func>(func), unwrapped);
+        } else if constexpr(::std::is_same_v<::std::decay_t<decltype(unwrapped)>,
+                                             ::std::string_view>) {
+          return visitStringView(::std::forward<Func>(func), unwrapped);
         } else {
           return ::std::forward<Func>(func)(unwrapped);
         }
@@ -705,6 +1877,32 @@ template <typename... T>
 inline constexpr bool isConstArgumentWrapper = isConstArgumentWrapperType<T...>::value;
 } // namespace utilities
 
+/**
+ * What only some complex expressions need is kept out of the expression (which is an alternative
+ * of every Expression) and allocated on demand
+ */
+struct ExpressionAnnotations {
+  /**
+   * the (cached) prefix sums of the span sizes: offsets[i] is the position of the first argument
+   * of span i among the span arguments and offsets.back() the number of span arguments. Only
+   * stored for two or more spans (the only span of an expression starts at position zero). Spans
+   * are only replaced when the expression is constructed or moved from (they cannot be resized) so
+   * the offsets are computed once
+   */
+  std::pmr::vector<size_t> spanArgumentOffsets;
+  /**
+   * the structural hash (see ComplexExpression::hash()) or zero if it has not been computed. It is
+   * reset whenever the mutable arguments are requested or moved out
+   */
+  std::atomic<std::uint64_t> cachedHash{};
+
+  static void resetHash(std::atomic<ExpressionAnnotations*> const& annotations) {
+    if(auto* existing = annotations.load(std::memory_order_acquire)) {
+      existing->cachedHash.store(0, std::memory_order_relaxed);
+    }
+  }
+};
+
 template <typename StaticArgumentsContainer, bool IsConstWrapper = false,
           typename... AdditionalAtoms>
 class ExpressionArgumentsWithAdditionalCustomAtomsWrapper {
@@ -719,19 +1917,48 @@ class ExpressionArgumentsWithAdditionalCustomAtomsWrapper {
                          ExpressionSpanArgumentsWithAdditionalCustomAtoms<AdditionalAtoms...> const,
                          ExpressionSpanArgumentsWithAdditionalCustomAtoms<AdditionalAtoms...>>;
   SpanArgumentsContainer& spanArguments;
+  /**
+   * the prefix sums of the span sizes (maintained by the expression, see
+   * ComplexExpression::indexSpanArguments) or nullptr if there are less than two spans
+   */
+  size_t const* spanArgumentOffsets;
+
+  size_t spanArgumentsSize() const {
+    if(spanArgumentOffsets != nullptr) {
+      return spanArgumentOffsets[spanArguments.size()];
+    }
+    return spanArguments.empty()
+               ? 0
+               : std::visit([](auto const& span) { return span.size(); }, spanArguments.front());
+  }
+
+  /**
+   * the index of the span holding the span argument at position (counting from the first span
+   * argument) -- a binary search over the offsets
+   */
+  size_t spanArgumentIndexOf(size_t position) const {
+    if(spanArgumentOffsets == nullptr) {
+      return 0;
+    }
+    return std::upper_bound(spanArgumentOffsets, spanArgumentOffsets + spanArguments.size() + 1,
+                            position) -
+           spanArgumentOffsets - 1;
+  }
+
+  size_t spanArgumentOffset(size_t spanIndex) const {
+    return spanArgumentOffsets == nullptr ? 0 : spanArgumentOffsets[spanIndex];
+  }
 
 public:
   ExpressionArgumentsWithAdditionalCustomAtomsWrapper(StaticArgumentsContainer& staticArguments,
                                                       DynamicArgumentsContainer& arguments,
-                                                      SpanArgumentsContainer& spanArguments)
-      : staticArguments(staticArguments), arguments(arguments), spanArguments(spanArguments) {}
+                                                      SpanArgumentsContainer& spanArguments,
+                                                      size_t const* spanArgumentOffsets)
+      : staticArguments(staticArguments), arguments(arguments), spanArguments(spanArguments),
+        spanArgumentOffsets(spanArgumentOffsets) {}
 
   size_t size() const {
-    return std::tuple_size_v<StaticArgumentsContainer> + arguments.size() +
-           std::accumulate(
-               spanArguments.begin(), spanArguments.end(), 0, [](auto soFar, auto& thisOne) {
-                 return soFar + std::visit([](auto&& thisOne) { return thisOne.size(); }, thisOne);
-               });
+    return std::tuple_size_v<StaticArgumentsContainer> + arguments.size() + spanArgumentsSize();
   }
   bool empty() const { return size() == 0; }
 
@@ -795,8 +2022,9 @@ public:
       }
       index = other.index;
       static_assert(std::is_trivially_destructible_v<decltype(container)>);
-      new(&container) decltype(container)(other.container.staticArguments,
-                                          other.container.arguments, other.container.spanArguments);
+      new(&container) decltype(container)(
+          other.container.staticArguments, other.container.arguments,
+          other.container.spanArguments, other.container.spanArgumentOffsets);
       return *this;
     }
     Iterator& operator=(Iterator const& other) {
@@ -805,8 +2033,9 @@ public:
       }
       index = other.index;
       static_assert(std::is_trivially_destructible_v<decltype(container)>);
-      new(&container) decltype(container)(other.container.staticArguments,
-                                          other.container.arguments, other.container.spanArguments);
+      new(&container) decltype(container)(
+          other.container.staticArguments, other.container.arguments,
+          other.container.spanArguments, other.container.spanArgumentOffsets);
       return *this;
     }
     Iterator(Iterator const& other) = default;
@@ -824,17 +2053,29 @@ public:
 
   Iterator<IsConstWrapper> end() const { return {*this, size()}; }
 
+  template <size_t I>
+  static ArgumentWrapper<IsConstWrapper, AdditionalAtoms...>
+  accessStaticArgument(StaticArgumentsContainer& staticArguments) {
+    return std::get<I>(staticArguments);
+  }
+
+  /**
+   * dispatches through a (compile-time) table of accessors, one per static argument, so that only
+   * the wrapper of the requested argument is constructed
+   */
   template <size_t... I>
-  constexpr ArgumentWrapper<IsConstWrapper, AdditionalAtoms...>
+  ArgumentWrapper<IsConstWrapper, AdditionalAtoms...>
   getStaticArgument(size_t index, std::index_sequence<I...> /*unused*/) const {
+    using Accessor =
+        ArgumentWrapper<IsConstWrapper, AdditionalAtoms...> (*)(StaticArgumentsContainer&);
+    static constexpr auto accessors =
+        std::array<Accessor, sizeof...(I)>{&accessStaticArgument<I>...};
     // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-constant-array-index)
-    return std::move(std::array<ArgumentWrapper<IsConstWrapper, AdditionalAtoms...>, sizeof...(I)>{
-        std::get<I>(staticArguments)...}[index]);
+    return accessors[index](staticArguments);
   }
 
   template <size_t... I>
-  constexpr ArgumentWrapper<IsConstWrapper, AdditionalAtoms...>
-  getStaticArgument(size_t index) const {
+  ArgumentWrapper<IsConstWrapper, AdditionalAtoms...> getStaticArgument(size_t index) const {
     return getStaticArgument(
         index, std::make_index_sequence<std::tuple_size_v<StaticArgumentsContainer>>());
   }
@@ -846,82 +2087,85 @@ public:
       if(index < std::tuple_size_v<StaticArgumentsContainer>) {
         return getStaticArgument(index);
       }
-    } else if((index - std::tuple_size_v<StaticArgumentsContainer>) < arguments.size()) {
+    }
+    if((index - std::tuple_size_v<StaticArgumentsContainer>) < arguments.size()) {
       return arguments[index - std::tuple_size_v<StaticArgumentsContainer>];
-    } else {
-      auto argumentPrefixScan = std::tuple_size_v<StaticArgumentsContainer> + arguments.size();
-      for(auto& spanArgument : spanArguments) {
-        if(index >= argumentPrefixScan &&
-           index < argumentPrefixScan +
-                       std::visit([](auto&& spanArgument) { return spanArgument.size(); },
-                                  spanArgument)) {
-          return std::visit(
-              [&](auto&& spanArgument) -> ArgumentWrapper<IsConstWrapper, AdditionalAtoms...> {
-                if constexpr((std::is_same_v<std::decay_t<decltype(spanArgument.at(0))>,
-                                             std::vector<bool>::const_reference> &&
-                              !IsConstWrapper) ||
-                             ((std::is_const_v<std::remove_reference_t<decltype(spanArgument)>> ||
-                               std::is_const_v<std::remove_reference_t<decltype(spanArgument.at(
-                                   0))>>)&&!IsConstWrapper)) {
-                  throw std::runtime_error("cannot convert const span to non-const argument");
-                } else {
-                  return spanArgument[index - argumentPrefixScan];
-                }
-              },
-              spanArgument);
-        }
-        argumentPrefixScan +=
-            std::visit([](auto&& spanArgument) { return spanArgument.size(); }, spanArgument);
-      }
     }
-#if defined(_MSC_VER)
-    __assume(0);
-#else
-    __builtin_unreachable();
-#endif
+    auto const position = index - std::tuple_size_v<StaticArgumentsContainer> - arguments.size();
+    auto const spanIndex = spanArgumentIndexOf(position);
+    return std::visit(
+        [&](auto&& spanArgument) -> ArgumentWrapper<IsConstWrapper, AdditionalAtoms...> {
+          if constexpr((std::is_same_v<std::decay_t<decltype(spanArgument.at(0))>,
+                                       ConstBitReference> &&
+                        !IsConstWrapper) ||
+                       ((std::is_const_v<std::remove_reference_t<decltype(spanArgument)>> ||
+                         std::is_const_v<std::remove_reference_t<decltype(spanArgument.at(
+                             0))>>)&&!IsConstWrapper)) {
+            throw std::runtime_error("cannot convert const span to non-const argument");
+          } else {
+            return spanArgument[position - spanArgumentOffset(spanIndex)];
+          }
+        },
+        spanArguments[spanIndex]);
   }
 
   ArgumentWrapper<IsConstWrapper, AdditionalAtoms...> getSpanArgument(size_t index) const {
-    auto argumentPrefixScan = std::tuple_size_v<StaticArgumentsContainer> + arguments.size();
-
-    for(auto& spanArgument : spanArguments) {
-      if(index >= argumentPrefixScan &&
-         index < argumentPrefixScan +
-                     std::visit([](auto& span) { return span.size(); }, spanArgument)) {
-        return std::visit(
-            [&](auto&& spanArgument) -> ArgumentWrapper<IsConstWrapper, AdditionalAtoms...> {
-              if constexpr((!IsConstWrapper &&
-                            std::is_same_v<std::decay_t<decltype(spanArgument.at(0))>,
-                                           std::vector<bool>::const_reference>) ||
-                           ((std::is_const_v<std::remove_reference_t<decltype(spanArgument)>> ||
-                             std::is_const_v<std::remove_reference_t<decltype(spanArgument.at(
-                                 0))>>)&&!IsConstWrapper)) {
-                throw std::runtime_error("cannot convert const span to non-const argument");
-              } else if constexpr(
-
-                  std::is_same_v<std::decay_t<decltype(spanArgument.at(0))>,
-                                 std::vector<bool>::reference> ||
-                  std::is_same_v<std::decay_t<decltype(spanArgument.at(0))>,
-                                 std::vector<bool>::const_reference>) {
-                if constexpr(IsConstWrapper ||
-                             std::is_same_v<std::decay_t<decltype(spanArgument.at(0))>,
-                                            std::vector<bool>::const_reference>) {
-                  return std::vector<bool>::const_reference(
-                      spanArgument.at(index - argumentPrefixScan));
-                } else {
-                  return std::vector<bool>::reference(spanArgument.at(index - argumentPrefixScan));
-                }
-              } else {
-                return spanArgument.at(index - argumentPrefixScan);
-              }
-            },
-            spanArgument);
-      }
-      argumentPrefixScan +=
-          std::visit([](auto&& spanArgument) { return spanArgument.size(); }, spanArgument);
+    auto const position = index - std::tuple_size_v<StaticArgumentsContainer> - arguments.size();
+    if(index < std::tuple_size_v<StaticArgumentsContainer> + arguments.size() ||
+       position >= spanArgumentsSize()) {
+      throw std::out_of_range("Expression has no argument with index " + std::to_string(index));
+    }
+    auto const spanIndex = spanArgumentIndexOf(position);
+    auto const positionInSpan = position - spanArgumentOffset(spanIndex);
+    return std::visit(
+        [&](auto&& spanArgument) -> ArgumentWrapper<IsConstWrapper, AdditionalAtoms...> {
+          if constexpr((!IsConstWrapper &&
+                        std::is_same_v<std::decay_t<decltype(spanArgument.at(0))>,
+                                       ConstBitReference>) ||
+                       ((std::is_const_v<std::remove_reference_t<decltype(spanArgument)>> ||
+                         std::is_const_v<std::remove_reference_t<decltype(spanArgument.at(
+                             0))>>)&&!IsConstWrapper)) {
+            throw std::runtime_error("cannot convert const span to non-const argument");
+          } else if constexpr(std::is_same_v<std::decay_t<decltype(spanArgument.at(0))>,
+                                             BitReference> ||
+                              std::is_same_v<std::decay_t<decltype(spanArgument.at(0))>,
+                                             ConstBitReference>) {
+            if constexpr(IsConstWrapper ||
+                         std::is_same_v<std::decay_t<decltype(spanArgument.at(0))>,
+                                        ConstBitReference>) {
+              return ConstBitReference(spanArgument.at(positionInSpan));
+            } else {
+              return BitReference(spanArgument.at(positionInSpan));
+            }
+          } else {
+            return spanArgument.at(positionInSpan);
+          }
+        },
+        spanArguments[spanIndex]);
+  }
+  /**
+   * false if the argument is a null value of a nullable span (see Span::withValidity)
+   */
+  bool isValid(size_t index) const {
+    if(index < std::tuple_size_v<StaticArgumentsContainer> + arguments.size()) {
+      return true;
     }
-    throw std::out_of_range("Expression has no argument with index " + std::to_string(index));
+    auto const position = index - std::tuple_size_v<StaticArgumentsContainer> - arguments.size();
+    if(position >= spanArgumentsSize()) {
+      throw std::out_of_range("Expression has no argument with index " + std::to_string(index));
+    }
+    auto const spanIndex = spanArgumentIndexOf(position);
+    return std::visit(
+        [&](auto& span) {
+          if constexpr(boss::utilities::isInstanceOfTemplate<std::decay_t<decltype(span)>,
+                                                             Span>::value) {
+            return span.isValid(position - spanArgumentOffset(spanIndex));
+          }
+          return true;
+        },
+        spanArguments[spanIndex]);
   }
+
   ArgumentWrapper<IsConstWrapper, AdditionalAtoms...> at(size_t index) const {
     if constexpr((std::tuple_size_v<StaticArgumentsContainer>) > 0) {
       if(index < std::tuple_size_v<StaticArgumentsContainer>) {
@@ -995,6 +2239,215 @@ private:
   StaticArgumentsTuple staticArguments{};
   ExpressionArgumentsWithAdditionalCustomAtoms<AdditionalCustomAtoms...> arguments{};
   ExpressionSpanArgumentsWithAdditionalCustomAtoms<AdditionalCustomAtoms...> spanArguments{};
+  using Annotations = ExpressionAnnotations;
+  mutable std::atomic<Annotations*> annotations{nullptr};
+
+  /**
+   * the annotations, allocated on first use. Concurrent first uses are safe (one of the allocated
+   * annotations is kept)
+   */
+  Annotations& annotate() const {
+    if(auto* existing = annotations.load(std::memory_order_acquire)) {
+      return *existing;
+    }
+    auto* allocated = new Annotations(); // NOLINT(cppcoreguidelines-owning-memory)
+    auto* expected = static_cast<Annotations*>(nullptr);
+    if(!annotations.compare_exchange_strong(expected, allocated, std::memory_order_acq_rel)) {
+      delete allocated; // NOLINT(cppcoreguidelines-owning-memory)
+      return *expected;
+    }
+    return *allocated;
+  }
+  void releaseAnnotations() {
+    delete annotations.exchange(nullptr); // NOLINT(cppcoreguidelines-owning-memory)
+  }
+  void resetHash() const { Annotations::resetHash(annotations); }
+  size_t const* spanArgumentOffsets() const {
+    auto const* existing = annotations.load(std::memory_order_acquire);
+    return existing == nullptr || existing->spanArgumentOffsets.empty()
+               ? nullptr
+               : existing->spanArgumentOffsets.data();
+  }
+  size_t spanArgumentOffset(size_t spanIndex) const {
+    auto const* offsets = spanArgumentOffsets();
+    return offsets == nullptr ? 0 : offsets[spanIndex];
+  }
+
+  template <typename, typename...> friend class ComplexExpressionWithAdditionalCustomAtoms;
+
+  using DynamicComplexExpression =
+      ComplexExpressionWithAdditionalCustomAtoms<std::tuple<>, AdditionalCustomAtoms...>;
+
+  /**
+   * calls visitor(span) for the span arguments of the expression (and its static subexpressions).
+   * The dynamic subexpressions are added to pending instead (see visitSpansRecursively)
+   */
+  template <typename Visitor>
+  void visitSpans(Visitor const& visitor, std::vector<DynamicComplexExpression*>& pending) {
+    auto visitArgument = [&visitor, &pending](auto& argument) {
+      using T = std::decay_t<decltype(argument)>;
+      if constexpr(std::is_same_v<T, DynamicComplexExpression>) {
+        pending.push_back(&argument);
+      } else if constexpr(boss::utilities::isInstanceOfTemplate<
+                              T, ComplexExpressionWithAdditionalCustomAtoms>::value) {
+        argument.visitSpansRecursively(visitor); // the nesting is bounded by the static type
+      }
+    };
+    std::apply([&visitArgument](auto&... staticArgument) { (visitArgument(staticArgument), ...); },
+               staticArguments);
+    for(auto& argument : arguments) {
+      std::visit(visitArgument, argument);
+    }
+    for(auto& spanArgument : spanArguments) {
+      std::visit(visitor, spanArgument);
+    }
+  }
+
+  /**
+   * calls visitor(span) for the span arguments of the expression and of all its subexpressions
+   * (which are visited with an explicit stack)
+   */
+  template <typename Visitor> void visitSpansRecursively(Visitor const& visitor) {
+    auto pending = std::vector<DynamicComplexExpression*>();
+    visitSpans(visitor, pending);
+    while(!pending.empty()) {
+      auto* expression = pending.back();
+      pending.pop_back();
+      expression->visitSpans(visitor, pending);
+    }
+  }
+
+  /**
+   * the complex expression at position index among the arguments or nullptr if it is not a
+   * dynamic argument holding a complex expression
+   */
+  DynamicComplexExpression const* complexArgumentAt(size_t index) const {
+    auto const staticArgumentsCount = std::tuple_size_v<StaticArgumentsTuple>;
+    if(index < staticArgumentsCount || index - staticArgumentsCount >= arguments.size()) {
+      return nullptr;
+    }
+    return std::get_if<DynamicComplexExpression>(&arguments[index - staticArgumentsCount]);
+  }
+
+  bool hasComplexArguments() const {
+    return std::any_of(arguments.begin(), arguments.end(), [](auto const& argument) {
+      return std::holds_alternative<DynamicComplexExpression>(argument);
+    });
+  }
+
+  /**
+   * moves the complex arguments that have complex arguments themselves to pending (leaving
+   * moved-from expressions behind) so that they can be destroyed without recursion
+   */
+  void detachComplexArguments(std::vector<DynamicComplexExpression>& pending) {
+    for(auto& argument : arguments) {
+      if(auto* complex = std::get_if<DynamicComplexExpression>(&argument)) {
+        if(complex->hasComplexArguments()) {
+          pending.push_back(std::move(*complex));
+        }
+      }
+    }
+  }
+
+  /**
+   * compares everything but the complex arguments both expressions have at the same position,
+   * those are added to pending (to be compared without recursion, see operator==)
+   */
+  template <typename Other>
+  bool shallowEquals(Other const& other,
+                     std::vector<std::pair<DynamicComplexExpression const*,
+                                           DynamicComplexExpression const*>>& pending) const {
+    if(getHead() != other.getHead() || getArguments().size() != other.getArguments().size()) {
+      return false;
+    }
+    auto sameLayout = false;
+    if constexpr(std::is_same_v<Other, ComplexExpressionWithAdditionalCustomAtoms>) {
+      sameLayout = arguments.size() == other.arguments.size() &&
+                   spanArguments.size() == other.spanArguments.size();
+      auto const spanSize = [](auto const& span) { return span.size(); };
+      for(auto i = size_t{}; sameLayout && i < spanArguments.size(); i++) {
+        sameLayout = std::visit(spanSize, spanArguments[i]) ==
+                     std::visit(spanSize, other.spanArguments[i]);
+      }
+    }
+    auto const spanArgumentsBegin = std::tuple_size_v<StaticArgumentsTuple> + arguments.size();
+    for(auto i = size_t{}; i < (sameLayout ? spanArgumentsBegin : getArguments().size()); i++) {
+      if(auto const* complex = complexArgumentAt(i)) {
+        if(auto const* otherComplex = other.complexArgumentAt(i)) {
+          pending.emplace_back(complex, otherComplex);
+          continue;
+        }
+      }
+      if(getArguments()[i] != other.getArguments()[i]) {
+        return false;
+      }
+    }
+    if constexpr(std::is_same_v<Other, ComplexExpressionWithAdditionalCustomAtoms>) {
+      for(auto i = size_t{}; sameLayout && i < spanArguments.size(); i++) {
+        auto const equal = std::visit(
+            [&](auto const& span) {
+              if(auto const* otherSpan =
+                     std::get_if<std::decay_t<decltype(span)>>(&other.spanArguments[i])) {
+                return hashing::spanValuesEqual(span, *otherSpan);
+              }
+              // spans of different types are compared value by value
+              auto const begin = spanArgumentsBegin + spanArgumentOffset(i);
+              for(auto j = begin; j < begin + span.size(); j++) {
+                if(getArguments()[j] != other.getArguments()[j]) {
+                  return false;
+                }
+              }
+              return true;
+            },
+            spanArguments[i]);
+        if(!equal) {
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+
+  /**
+   * prints the expression with an explicit stack of the subexpressions that are being printed
+   */
+  static void printWithoutRecursion(::std::ostream& out, DynamicComplexExpression const& root) {
+    auto frames = std::vector<std::pair<DynamicComplexExpression const*, size_t>>{{&root, 0}};
+    out << root.getHead() << "[";
+    while(!frames.empty()) {
+      auto const [expression, index] = frames.back();
+      if(index == expression->getArguments().size()) {
+        out << "]";
+        frames.pop_back();
+        continue;
+      }
+      frames.back().second++;
+      if(index > 0) {
+        out << ",";
+      }
+      if(auto const* complex = expression->complexArgumentAt(index)) {
+        out << complex->getHead() << "[";
+        frames.emplace_back(complex, 0);
+      } else {
+        out << expression->getArguments()[index];
+      }
+    }
+  }
+
+  void indexSpanArguments() {
+    if(spanArguments.size() < 2) {
+      return;
+    }
+    auto offsets = std::pmr::vector<size_t>(spanArguments.get_allocator());
+    offsets.reserve(spanArguments.size() + 1);
+    offsets.push_back(0);
+    for(auto const& spanArgument : spanArguments) {
+      offsets.push_back(offsets.back() +
+                        std::visit([](auto const& span) { return span.size(); }, spanArgument));
+    }
+    // NOLINTNEXTLINE(cppcoreguidelines-owning-memory)
+    delete annotations.exchange(new Annotations{std::move(offsets)});
+  }
 
 public:
   template <size_t... I>
@@ -1030,10 +2483,26 @@ public:
              ExpressionArgumentsWithAdditionalCustomAtoms<AdditionalCustomAtoms...>,
              ExpressionSpanArgumentsWithAdditionalCustomAtoms<AdditionalCustomAtoms...>>
   decompose() && {
+    releaseAnnotations();
     return {std::move(head), std::move(staticArguments), std::move(arguments),
             std::move(spanArguments)};
   }
 
+  /**
+   * the arguments following the static ones (in the same memory resource). Without static
+   * arguments, the vector is moved as a whole
+   */
+  static ExpressionArgumentsWithAdditionalCustomAtoms<AdditionalCustomAtoms...>
+  nonStaticArguments(ExpressionArgumentsWithAdditionalCustomAtoms<AdditionalCustomAtoms...>&&
+                         arguments) {
+    if constexpr(std::tuple_size_v<StaticArgumentsTuple> == 0) {
+      return std::move(arguments);
+    } else {
+      return {std::move_iterator(next(begin(arguments), std::tuple_size_v<StaticArgumentsTuple>)),
+              std::move_iterator(end(arguments)), arguments.get_allocator()};
+    }
+  }
+
   template <size_t... I>
   ExpressionArgumentsWithAdditionalCustomAtoms<AdditionalCustomAtoms...>
   convertStaticToDynamicArguments(std::index_sequence<I...> /*unused*/) const {
@@ -1052,7 +2521,9 @@ public:
       ExpressionSpanArgumentsWithAdditionalCustomAtoms<AdditionalCustomAtoms...>&& spanArguments =
           {})
       : head(head), staticArguments(std::move(staticArguments)), arguments(std::move(arguments)),
-        spanArguments(std::move(spanArguments)) {}
+        spanArguments(std::move(spanArguments)) {
+    indexSpanArguments();
+  }
 
   ComplexExpressionWithAdditionalCustomAtoms(
       Symbol&& head, StaticArgumentsTuple&& staticArguments,
@@ -1060,7 +2531,9 @@ public:
       ExpressionSpanArgumentsWithAdditionalCustomAtoms<AdditionalCustomAtoms...>&& spanArguments =
           {})
       : head(std::move(head)), staticArguments(std::move(staticArguments)),
-        arguments(std::move(arguments)), spanArguments(std::move(spanArguments)) {}
+        arguments(std::move(arguments)), spanArguments(std::move(spanArguments)) {
+    indexSpanArguments();
+  }
 
   template <typename = std::enable_if<std::tuple_size<StaticArgumentsTuple>::value == 0>>
   explicit ComplexExpressionWithAdditionalCustomAtoms(
@@ -1071,9 +2544,7 @@ public:
             convertToTuple(
                 arguments,
                 std::make_index_sequence<std::tuple_size<StaticArgumentsTuple>::value>()),
-            {std::move_iterator(
-                 next(begin(arguments), std::tuple_size<StaticArgumentsTuple>::value)),
-             std::move_iterator(end(arguments))}){};
+            nonStaticArguments(std::move(arguments))){};
 
   template <typename = std::enable_if<std::tuple_size<StaticArgumentsTuple>::value == 0>>
   explicit ComplexExpressionWithAdditionalCustomAtoms(
@@ -1084,9 +2555,7 @@ public:
             convertToTuple(
                 arguments,
                 std::make_index_sequence<std::tuple_size<StaticArgumentsTuple>::value>()),
-            {std::move_iterator(
-                 next(begin(arguments), std::tuple_size<StaticArgumentsTuple>::value)),
-             std::move_iterator(end(arguments))}){};
+            nonStaticArguments(std::move(arguments))){};
 
   operator ComplexExpressionWithAdditionalCustomAtoms< // NOLINT(hicpp-explicit-conversions)
       std::tuple<>, AdditionalCustomAtoms...>() const {
@@ -1128,17 +2597,19 @@ public:
           },
           std::move(span));
     }
+    indexSpanArguments();
   }
 
   ExpressionArgumentsWithAdditionalCustomAtomsWrapper<decltype(staticArguments), false,
                                                       AdditionalCustomAtoms...>
   getArguments() {
-    return {staticArguments, arguments, spanArguments};
+    resetHash(); // the arguments might be modified through the wrapper
+    return {staticArguments, arguments, spanArguments, spanArgumentOffsets()};
   }
   ExpressionArgumentsWithAdditionalCustomAtomsWrapper<decltype(staticArguments) const, true,
                                                       AdditionalCustomAtoms...>
   getArguments() const {
-    return {staticArguments, arguments, spanArguments};
+    return {staticArguments, arguments, spanArguments, spanArgumentOffsets()};
   }
 
   ExpressionArgumentsWithAdditionalCustomAtoms<AdditionalCustomAtoms...> const&
@@ -1147,13 +2618,27 @@ public:
   };
 
   ExpressionArgumentsWithAdditionalCustomAtoms<AdditionalCustomAtoms...> getDynamicArguments() && {
+    resetHash();
     return std::move(arguments);
   };
 
   auto const& getStaticArguments() const& { return staticArguments; }
-  auto getStaticArguments() && { return std::move(staticArguments); }
+  auto getStaticArguments() && {
+    resetHash();
+    return std::move(staticArguments);
+  }
   auto const& getSpanArguments() const& { return spanArguments; }
-  auto getSpanArguments() && { return std::move(spanArguments); }
+  /**
+   * the resource the arguments were allocated from, e.g., to allocate the arguments of derived
+   * expressions from the same arena
+   */
+  std::pmr::memory_resource* getMemoryResource() const {
+    return arguments.get_allocator().resource();
+  }
+  auto getSpanArguments() && {
+    releaseAnnotations();
+    return std::move(spanArguments);
+  }
 
   ExpressionWithAdditionalCustomAtoms<AdditionalCustomAtoms...> getArgument(size_t index) && {
     return visit(
@@ -1181,6 +2666,9 @@ public:
                   return ::std::forward<decltype(arg)>(arg);
                 },
                 ::std::forward<decltype(unwrapped)>(unwrapped));
+          } else if constexpr(::std::is_same_v<::std::decay_t<decltype(unwrapped)>,
+                                               ::std::string_view>) {
+            return ::std::string(unwrapped);
           } else {
             return ::std::forward<decltype(unwrapped)>(unwrapped);
           }
@@ -1226,6 +2714,9 @@ public:
                   return arg.clone(reason...);
                 },
                 unwrapped);
+          } else if constexpr(::std::is_same_v<::std::decay_t<decltype(unwrapped)>,
+                                               ::std::string_view>) {
+            return ::std::string(unwrapped);
           } else {
             return unwrapped;
           }
@@ -1236,21 +2727,210 @@ public:
   Symbol const& getHead() const& { return head; };
   Symbol getHead() && { return std::move(head); };
 
-  ~ComplexExpressionWithAdditionalCustomAtoms() = default;
+  /**
+   * Nested complex arguments are destroyed with an explicit stack: deep expressions (e.g., long
+   * chains of And) would overflow the call stack otherwise
+   */
+  ~ComplexExpressionWithAdditionalCustomAtoms() {
+    auto pending = std::vector<DynamicComplexExpression>();
+    detachComplexArguments(pending);
+    while(!pending.empty()) {
+      auto expression = std::move(pending.back());
+      pending.pop_back();
+      expression.detachComplexArguments(pending);
+    }
+    releaseAnnotations();
+  }
   ComplexExpressionWithAdditionalCustomAtoms(
-      ComplexExpressionWithAdditionalCustomAtoms&&) noexcept = default;
+      ComplexExpressionWithAdditionalCustomAtoms&& other) noexcept
+      : head(std::move(other.head)), staticArguments(std::move(other.staticArguments)),
+        arguments(std::move(other.arguments)), spanArguments(std::move(other.spanArguments)),
+        annotations(other.annotations.exchange(nullptr)) {}
   ComplexExpressionWithAdditionalCustomAtoms&
-  operator=(ComplexExpressionWithAdditionalCustomAtoms&&) noexcept = default;
+  operator=(ComplexExpressionWithAdditionalCustomAtoms&& other) noexcept {
+    head = std::move(other.head);
+    staticArguments = std::move(other.staticArguments);
+    arguments = std::move(other.arguments);
+    spanArguments = std::move(other.spanArguments);
+    delete annotations.exchange( // NOLINT(cppcoreguidelines-owning-memory)
+        other.annotations.exchange(nullptr));
+    return *this;
+  }
+
+private:
+  template <typename T>
+  static void hashArgument(hashing::Accumulator& accumulator, T const& argument) {
+    using Expression = ExpressionWithAdditionalCustomAtoms<AdditionalCustomAtoms...>;
+    if constexpr(boss::utilities::isInstanceOfTemplate<
+                     T, ComplexExpressionWithAdditionalCustomAtoms>::value) {
+      accumulator.addComplex(argument.hash());
+    } else if constexpr(std::is_same_v<T, Expression>) {
+      std::visit([&accumulator](auto const& argument) { hashArgument(accumulator, argument); },
+                 argument);
+    } else {
+      accumulator.addAtom(argument);
+    }
+  }
+
+  /**
+   * adds the span arguments and the head to the hash of the other arguments
+   */
+  std::uint64_t finishHash(hashing::Accumulator& accumulator) const {
+    for(auto const& spanArgument : spanArguments) {
+      std::visit([&accumulator](auto const& span) { accumulator.addSpan(span); }, spanArgument);
+    }
+    return accumulator.finish(head);
+  }
+
+  /**
+   * computes the hash bottom-up with an explicit stack (of the subexpressions whose arguments are
+   * being hashed): a subexpression is finished once the hashes of all its arguments are known.
+   * Cached hashes of subexpressions are used but only the hash of the root is cached
+   */
+  static std::uint64_t hashWithoutRecursion(DynamicComplexExpression const& root) {
+    struct Frame {
+      DynamicComplexExpression const* expression;
+      hashing::Accumulator accumulator;
+    };
+    auto frames = std::vector<Frame>{{&root, {}}};
+    while(true) {
+      auto& [expression, accumulator] = frames.back();
+      if(accumulator.nextPosition() < expression->arguments.size()) {
+        auto const& argument = expression->arguments[accumulator.nextPosition()];
+        auto const* complex = std::get_if<DynamicComplexExpression>(&argument);
+        if(complex != nullptr && !complex->hasHash()) {
+          frames.push_back({complex, {}});
+        } else {
+          hashArgument(accumulator, argument);
+        }
+        continue;
+      }
+      auto const hash = expression->finishHash(accumulator);
+      frames.pop_back();
+      if(frames.empty()) {
+        return hash;
+      }
+      frames.back().accumulator.addComplex(hash);
+    }
+  }
+
+public:
+  /**
+   * A structural hash of the expression: expressions that compare equal have the same hash. It is
+   * computed once (the span values are hashed in bulk, subexpressions without recursion) and cached
+   * until the mutable arguments are requested. Writes through wrappers or references to arguments
+   * that were obtained before the hash was computed (or through a subexpression that was accessed
+   * before) are not detected
+   */
+  std::uint64_t hash() const {
+    if(auto const* existing = annotations.load(std::memory_order_acquire)) {
+      if(auto const cached = existing->cachedHash.load(std::memory_order_relaxed); cached != 0) {
+        return cached;
+      }
+    }
+    auto result = std::uint64_t{};
+    if constexpr(std::tuple_size_v<StaticArgumentsTuple> == 0) {
+      result = hashWithoutRecursion(*this);
+    } else {
+      // the nesting of static arguments is bounded by their types
+      auto accumulator = hashing::Accumulator();
+      std::apply(
+          [&accumulator](auto const&... staticArgument) {
+            (hashArgument(accumulator, staticArgument), ...);
+          },
+          staticArguments);
+      for(auto const& argument : arguments) {
+        hashArgument(accumulator, argument);
+      }
+      result = finishHash(accumulator);
+    }
+    annotate().cachedHash.store(result, std::memory_order_relaxed);
+    return result;
+  }
+  bool hasHash() const {
+    auto const* existing = annotations.load(std::memory_order_acquire);
+    return existing != nullptr && existing->cachedHash.load(std::memory_order_relaxed) != 0;
+  }
+
+private:
+  /**
+   * the bytes held by the expression itself (and its static subexpressions). The dynamic
+   * subexpressions are added to pending instead (see footprint)
+   */
+  MemoryFootprint
+  footprintWithoutSubexpressions(SharedBuffers& counted,
+                                 std::vector<DynamicComplexExpression const*>& pending) const {
+    using Expression = ExpressionWithAdditionalCustomAtoms<AdditionalCustomAtoms...>;
+    using SpanArgument = ExpressionSpanArgumentWithAdditionalCustomAtoms<AdditionalCustomAtoms...>;
+    auto result = MemoryFootprint{};
+    result.owned += arguments.capacity() * sizeof(Expression) +
+                    spanArguments.capacity() * sizeof(SpanArgument);
+    if(auto const* existing = annotations.load(std::memory_order_acquire)) {
+      result.owned +=
+          sizeof(Annotations) + existing->spanArgumentOffsets.capacity() * sizeof(size_t);
+    }
+    auto accountFor = [&result, &counted, &pending](auto const& argument) {
+      using T = std::decay_t<decltype(argument)>;
+      if constexpr(std::is_same_v<T, DynamicComplexExpression>) {
+        pending.push_back(&argument);
+      } else if constexpr(boss::utilities::isInstanceOfTemplate<
+                              T, ComplexExpressionWithAdditionalCustomAtoms>::value) {
+        result += argument.footprint(&counted); // the nesting is bounded by the static type
+      } else if constexpr(std::is_same_v<T, std::string>) {
+        result.owned += allocatedBytes(argument);
+      }
+    };
+    std::apply([&accountFor](auto const&... staticArgument) { (accountFor(staticArgument), ...); },
+               staticArguments);
+    for(auto const& argument : arguments) {
+      std::visit(accountFor, argument);
+    }
+    for(auto const& spanArgument : spanArguments) {
+      result += std::visit([&counted](auto const& span) { return span.footprint(&counted); },
+                           spanArgument);
+    }
+    return result;
+  }
 
+public:
+  /**
+   * The bytes held by the expression (but not the expression object itself) and its
+   * subexpressions, see MemoryFootprint. Argument vectors are accounted for by their capacity.
+   * Subexpressions are visited with an explicit stack and shared buffers are counted once (per
+   * call or, if passed, per set of counted buffers)
+   */
+  MemoryFootprint footprint(SharedBuffers* counted = nullptr) const {
+    auto buffers = SharedBuffers();
+    auto& countedBuffers = counted != nullptr ? *counted : buffers;
+    auto pending = std::vector<DynamicComplexExpression const*>();
+    auto result = footprintWithoutSubexpressions(countedBuffers, pending);
+    while(!pending.empty()) {
+      auto const* expression = pending.back();
+      pending.pop_back();
+      result += expression->footprintWithoutSubexpressions(countedBuffers, pending);
+    }
+    return result;
+  }
+
+  /**
+   * Compares the arguments pairwise (cached hashes are not used: they can be stale, see hash()).
+   * If both expressions have the same static arguments and their dynamic and span arguments are
+   * laid out the same way, spans are compared as a whole (see hashing::spanValuesEqual).
+   * Subexpressions are compared with an explicit stack
+   */
   template <typename... StaticArgumentTypes>
   bool operator==(
       ComplexExpressionWithAdditionalCustomAtoms<std::tuple<StaticArgumentTypes...>,
                                                  AdditionalCustomAtoms...> const& other) const {
-    if(getHead() != other.getHead() || getArguments().size() != other.getArguments().size()) {
+    auto pending =
+        std::vector<std::pair<DynamicComplexExpression const*, DynamicComplexExpression const*>>();
+    if(!shallowEquals(other, pending)) {
       return false;
     }
-    for(auto i = 0U; i < getArguments().size(); i++) {
-      if(getArguments()[i] != other.getArguments()[i]) {
+    while(!pending.empty()) {
+      auto const [expression, otherExpression] = pending.back();
+      pending.pop_back();
+      if(!expression->shallowEquals(*otherExpression, pending)) {
         return false;
       }
     }
@@ -1260,42 +2940,100 @@ public:
     return !(*this == other);
   }
 
+  /**
+   * Subexpressions are cloned depth-first with an explicit stack (of the subexpressions whose
+   * arguments are being cloned). Every node is copied, the values of shared spans are not (see
+   * share())
+   */
   template <typename... Reason>
   ComplexExpressionWithAdditionalCustomAtoms clone(Reason... reason) const {
     checkCloneWithoutReason(reason...);
-    ExpressionArgumentsWithAdditionalCustomAtoms<AdditionalCustomAtoms...> copiedArgs;
-    ExpressionSpanArgumentsWithAdditionalCustomAtoms<AdditionalCustomAtoms...> newSpanArguments;
     static_assert(std::tuple_size_v<decltype(staticArguments)> == 0);
-    for(auto const& arg : getDynamicArguments()) {
-      copiedArgs.emplace_back(arg.clone(reason...));
+    struct Frame {
+      ComplexExpressionWithAdditionalCustomAtoms const* source;
+      ExpressionArgumentsWithAdditionalCustomAtoms<AdditionalCustomAtoms...> copiedArgs;
+    };
+    auto frames = std::vector<Frame>();
+    frames.push_back({this, {}});
+    frames.back().copiedArgs.reserve(arguments.size());
+    while(true) {
+      auto& frame = frames.back();
+      auto const& sourceArguments = frame.source->arguments;
+      if(frame.copiedArgs.size() < sourceArguments.size()) {
+        auto const& arg = sourceArguments[frame.copiedArgs.size()];
+        if(auto const* complex = std::get_if<ComplexExpressionWithAdditionalCustomAtoms>(&arg)) {
+          checkCloneWithoutReason(reason...);
+          frames.push_back({complex, {}});
+          frames.back().copiedArgs.reserve(complex->arguments.size());
+        } else {
+          frame.copiedArgs.emplace_back(arg.clone(reason...));
+        }
+        continue;
+      }
+      ExpressionSpanArgumentsWithAdditionalCustomAtoms<AdditionalCustomAtoms...> newSpanArguments;
+      newSpanArguments.reserve(frame.source->spanArguments.size());
+      for(auto& it : frame.source->spanArguments) {
+        newSpanArguments.push_back(std::visit(
+            [&](auto const& v)
+                -> ExpressionSpanArgumentWithAdditionalCustomAtoms<AdditionalCustomAtoms...> {
+              return v.clone(reason...);
+            },
+            it));
+      }
+      auto result = ComplexExpressionWithAdditionalCustomAtoms(
+          frame.source->head, {}, std::move(frame.copiedArgs), std::move(newSpanArguments));
+      frames.pop_back();
+      if(frames.empty()) {
+        return result;
+      }
+      frames.back().copiedArgs.emplace_back(std::move(result));
     }
+  }
 
-    newSpanArguments.reserve(spanArguments.size());
-    for(auto& it : spanArguments) {
-      newSpanArguments.push_back(std::visit(
-          [&](auto const& v)
-              -> ExpressionSpanArgumentWithAdditionalCustomAtoms<AdditionalCustomAtoms...> {
-            return v.clone(reason...);
-          },
-          it));
-    }
+  /**
+   * Shares the spans of the expression and of all its subexpressions (see Span::share): clones of
+   * the shared expression (and of its clones) reference the same buffers, i.e., cloning copies the
+   * (small) expression nodes but not the values. Reading (through the const or non-const
+   * arguments) does not copy either. The buffers must be treated as immutable: use makeWritable()
+   * before writing to the values of a shared expression or of any of its clones
+   */
+  ComplexExpressionWithAdditionalCustomAtoms share() && {
+    visitSpansRecursively([](auto& span) { span = std::move(span).share(); });
+    return std::move(*this);
+  }
 
-    return ComplexExpressionWithAdditionalCustomAtoms(head, {}, std::move(copiedArgs),
-                                                      std::move(newSpanArguments));
+  /**
+   * The copy-on-write path for shared expressions: the values of spans (of the expression and its
+   * subexpressions) that are referenced by other spans are copied (see Span::makeWritable,
+   * StringSpan::makeWritable and DictionarySpan::makeWritable)
+   */
+  ComplexExpressionWithAdditionalCustomAtoms& makeWritable() & {
+    visitSpansRecursively([](auto& span) {
+      // spans of const values cannot be written to
+      if constexpr(!boss::utilities::isInstanceOfTemplateWithConstArguments<
+                       std::decay_t<decltype(span)>, Span>::value) {
+        span.makeWritable();
+      }
+    });
+    return *this;
   }
 
   /**
    * a specialization for complex expressions is needed. Otherwise the complex
    * expression and all its arguments have to be copied to be converted to an
-   * Expression
+   * Expression. Subexpressions are printed without recursion
    */
   friend ::std::ostream& operator<<(::std::ostream& out,
                                     ComplexExpressionWithAdditionalCustomAtoms const& e) {
     out << e.getHead() << "[";
-    if(!e.getArguments().empty()) {
-      out << e.getArguments().front();
-      for(auto it = ::std::next(e.getArguments().begin()); it != e.getArguments().end(); ++it) {
-        out << "," << *it;
+    for(auto i = size_t{}; i < e.getArguments().size(); i++) {
+      if(i > 0) {
+        out << ",";
+      }
+      if(auto const* complex = e.complexArgumentAt(i)) {
+        DynamicComplexExpression::printWithoutRecursion(out, *complex);
+      } else {
+        out << e.getArguments()[i];
       }
     }
     out << "]";
@@ -1362,8 +3100,8 @@ T& get(generic::ArgumentWrapper<ConstWrappee, AdditionalCustomAtoms...> const& w
                                         MovableReferenceWrapper<T>>) {
             return argument.get();
           } else if constexpr(::std::is_same_v<::std::decay_t<decltype(argument)>,
-                                               ::std::vector<bool>::reference>) {
-            if constexpr(::std::is_same_v<::std::decay_t<T>, ::std::vector<bool>::reference>) {
+                                               BitReference>) {
+            if constexpr(::std::is_same_v<::std::decay_t<T>, BitReference>) {
 
               return argument;
             }
@@ -1394,22 +3132,31 @@ T const& get(ArgumentWrapper<true, AdditionalCustomAtoms...> const& wrapper) {
         [](auto const& wrappee) -> T const& {
           if constexpr(boss::utilities::isInstanceOfTemplate<::std::decay_t<decltype(wrappee)>,
                                                              MovableReferenceWrapper>::value) {
-            if constexpr(::std::is_same_v<typename ::std::decay_t<decltype(wrappee)>::type, T>) {
+            // values of spans of const values are wrapped as T const
+            using Wrapped = typename ::std::decay_t<decltype(wrappee)>::type;
+            if constexpr(::std::is_same_v<::std::remove_const_t<Wrapped>, T>) {
               return wrappee.get();
             } else if constexpr(boss::utilities::isInstanceOfTemplate<
                                     ::std::decay_t<decltype(wrappee.get())>,
-                                    ExpressionWithAdditionalCustomAtoms>::value) {
+                                    ExpressionWithAdditionalCustomAtoms>::value &&
+                                !::std::is_same_v<::std::string_view, T>) {
               return std::get<T>(wrappee.get());
             }
             throw ::std::bad_variant_access();
           } else if constexpr(::std::is_same_v<::std::decay_t<decltype(wrappee)>,
-                                               ::std::vector<bool>::reference> ||
+                                               BitReference> ||
                               ::std::is_same_v<::std::decay_t<decltype(wrappee)>,
-                                               ::std::vector<bool>::const_reference>) {
+                                               ConstBitReference>) {
             if constexpr(::std::is_same_v<bool, T>) {
               return wrappee;
             }
             throw ::std::bad_variant_access();
+          } else if constexpr(::std::is_same_v<::std::decay_t<decltype(wrappee)>,
+                                               ::std::string_view>) {
+            if constexpr(::std::is_same_v<::std::string_view, T>) {
+              return wrappee;
+            }
+            throw ::std::bad_variant_access();
           } else {
             return get<T>(wrappee);
           }
@@ -1431,21 +3178,28 @@ bool holds_alternative(
     generic::ArgumentWrapper<ConstWrappee, AdditionalCustomAtoms...> const& wrapper) {
   return ::std::visit(
       [](auto& argument) {
+        // values of const expressions (and spans of const values) are wrapped as T const
         if constexpr(::std::is_same_v<::std::decay_t<decltype(argument)>,
-                                      MovableReferenceWrapper<T>>) {
+                                      MovableReferenceWrapper<T>> ||
+                     ::std::is_same_v<::std::decay_t<decltype(argument)>,
+                                      MovableReferenceWrapper<T const>>) {
           return true;
         } else if constexpr(::std::is_same_v<::std::decay_t<decltype(argument)>,
-                                             ::std::vector<bool>::reference>) {
-          if constexpr(::std::is_same_v<::std::decay_t<T>, ::std::vector<bool>::reference>) {
+                                             BitReference>) {
+          if constexpr(::std::is_same_v<::std::decay_t<T>, BitReference>) {
 
             return true;
           }
+        } else if constexpr(::std::is_same_v<::std::decay_t<decltype(argument)>,
+                                             ::std::string_view>) {
+          return ::std::is_same_v<::std::decay_t<T>, ::std::string_view>;
         } else if constexpr(boss::utilities::isInstanceOfTemplate<
                                 ::std::decay_t<decltype(argument)>,
                                 MovableReferenceWrapper>::value) {
           if constexpr(boss::utilities::isInstanceOfTemplate<
                            ::std::decay_t<decltype(argument.get())>,
-                           ExpressionWithAdditionalCustomAtoms>::value) {
+                           ExpressionWithAdditionalCustomAtoms>::value &&
+                       !::std::is_same_v<::std::decay_t<T>, ::std::string_view>) {
             return ::std::holds_alternative<T>(argument.get());
           }
         }
@@ -1459,21 +3213,30 @@ decltype(auto) get_if(ArgumentWrapper<ConstWrappee, AdditionalCustomAtoms...> co
   return ::std::visit(
       [](auto& argument) -> std::conditional_t<ConstWrappee, T const*, T*> {
         if constexpr(::std::is_same_v<::std::decay_t<decltype(argument)>,
-                                      MovableReferenceWrapper<T>>) {
+                                      MovableReferenceWrapper<T>> ||
+                     (ConstWrappee && ::std::is_same_v<::std::decay_t<decltype(argument)>,
+                                                       MovableReferenceWrapper<T const>>)) {
           return &argument.get();
         } else if constexpr(::std::is_same_v<::std::decay_t<decltype(argument)>,
-                                             ::std::vector<bool>::reference>) {
-          if constexpr(::std::is_same_v<::std::decay_t<T>, ::std::vector<bool>::reference>) {
+                                             BitReference>) {
+          if constexpr(::std::is_same_v<::std::decay_t<T>, BitReference>) {
 
             return &argument;
           }
           return nullptr;
+        } else if constexpr(::std::is_same_v<::std::decay_t<decltype(argument)>,
+                                             ::std::string_view>) {
+          if constexpr(::std::is_same_v<::std::decay_t<T>, ::std::string_view>) {
+            return &argument;
+          }
+          return nullptr;
         } else if constexpr(boss::utilities::isInstanceOfTemplate<
                                 ::std::decay_t<decltype(argument)>,
                                 MovableReferenceWrapper>::value) {
           if constexpr(boss::utilities::isInstanceOfTemplate<
                            ::std::decay_t<decltype(argument.get())>,
-                           ExpressionWithAdditionalCustomAtoms>::value) {
+                           ExpressionWithAdditionalCustomAtoms>::value &&
+                       !::std::is_same_v<::std::decay_t<T>, ::std::string_view>) {
             return ::std::get_if<T>(&argument.get());
           }
           return nullptr;
@@ -1484,6 +3247,28 @@ decltype(auto) get_if(ArgumentWrapper<ConstWrappee, AdditionalCustomAtoms...> co
       wrapper->getArgument());
 }
 
+/**
+ * The bytes held by the expression including the expression object itself, see MemoryFootprint
+ */
+template <typename... AdditionalCustomAtoms>
+MemoryFootprint footprint(ExpressionWithAdditionalCustomAtoms<AdditionalCustomAtoms...> const& e,
+                          SharedBuffers* counted = nullptr) {
+  auto result = MemoryFootprint{};
+  result.owned = sizeof(e);
+  return ::std::visit(
+      [&result, counted](auto const& argument) {
+        using T = ::std::decay_t<decltype(argument)>;
+        if constexpr(boss::utilities::isInstanceOfTemplate<
+                         T, ComplexExpressionWithAdditionalCustomAtoms>::value) {
+          result += argument.footprint(counted);
+        } else if constexpr(::std::is_same_v<T, ::std::string>) {
+          result.owned += allocatedBytes(argument);
+        }
+        return result;
+      },
+      e);
+}
+
 } // namespace generic
 using DefaultExpressionSystem = generic::ExtensibleExpressionSystem<>;
 
@@ -1506,7 +3291,10 @@ using expressions::Expression;
 using expressions::ExpressionArguments;
 using expressions::Span; // NOLINT
 using expressions::Symbol;
+using expressions::MemoryFootprint;
+using expressions::SharedBuffers;
 using expressions::generic::ExtensibleExpressionSystem; // NOLINT
+using expressions::generic::footprint;                  // NOLINT
 using expressions::generic::get;                        // NOLINT
 using expressions::generic::get_if;                     // NOLINT
 using expressions::generic::holds_alternative;          // NOLINT
@@ -1559,7 +3347,36 @@ decltype(auto) visit(Func&& func,
 };
 template <> struct hash<boss::expressions::Symbol> {
   ::std::size_t operator()(boss::expressions::Symbol const& s) const noexcept {
-    return ::std::hash<::std::string>{}(s.getName());
+    return s.getHash();
+  }
+};
+template <typename StaticArgumentsTuple, typename... AdditionalCustomAtoms>
+struct hash<boss::expressions::generic::ComplexExpressionWithAdditionalCustomAtoms<
+    StaticArgumentsTuple, AdditionalCustomAtoms...>> {
+  ::std::size_t
+  operator()(boss::expressions::generic::ComplexExpressionWithAdditionalCustomAtoms<
+             StaticArgumentsTuple, AdditionalCustomAtoms...> const& e) const {
+    return e.hash();
+  }
+};
+template <typename... AdditionalCustomAtoms>
+struct hash<
+    boss::expressions::generic::ExpressionWithAdditionalCustomAtoms<AdditionalCustomAtoms...>> {
+  ::std::size_t
+  operator()(boss::expressions::generic::ExpressionWithAdditionalCustomAtoms<
+             AdditionalCustomAtoms...> const& e) const {
+    return ::std::visit(
+        [](auto const& e) -> ::std::size_t {
+          if constexpr(boss::utilities::isInstanceOfTemplate<
+                           ::std::decay_t<decltype(e)>,
+                           boss::expressions::generic::ComplexExpressionWithAdditionalCustomAtoms>::
+                           value) {
+            return e.hash();
+          } else {
+            return boss::expressions::hashing::hashAtom(e);
+          }
+        },
+        e);
   }
 };
 
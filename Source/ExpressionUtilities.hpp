@@ -3,17 +3,64 @@
 #include "Expression.hpp"
 #include "Utilities.hpp"
 #include <array>
+#include <cstdint>
+#include <memory_resource>
+#include <string_view>
 #include <tuple>
 #include <type_traits>
 #include <utility>
 
 namespace boss::utilities {
 template <typename ExpressionSystem = DefaultExpressionSystem> class ExtensibleExpressionBuilder {
-  Symbol const s;
+  /**
+   * the builder only holds a view of the name (and its hash) so it can be constructed at compile
+   * time. When constructed from a Symbol or a string, the view points into the SymbolTable (which
+   * never releases names)
+   */
+  ::std::string_view name;
+  ::std::uint64_t hash;
+  /**
+   * see allocatingFrom (nullptr for the default resource)
+   */
+  ::std::pmr::memory_resource* resource = nullptr;
+
+  Symbol symbol() const { return Symbol(name, hash); }
+  ::std::pmr::memory_resource* memoryResource() const {
+    return resource != nullptr ? resource : ::std::pmr::get_default_resource();
+  }
 
 public:
-  explicit ExtensibleExpressionBuilder(Symbol const& s) : s(s){};
-  explicit ExtensibleExpressionBuilder(const ::std::string& s) : s(Symbol(s)){};
+  constexpr ExtensibleExpressionBuilder(char const* name, size_t length)
+      : name(name, length), hash(expressions::atoms::hashSymbolName(this->name)){};
+  explicit ExtensibleExpressionBuilder(Symbol const& s) : name(s.getName()), hash(s.getHash()){};
+  explicit ExtensibleExpressionBuilder(const ::std::string& s)
+      : ExtensibleExpressionBuilder(Symbol(s)){};
+
+  /**
+   * The hash of the symbol this builder produces. It is a compile-time constant for literals which
+   * means engines can switch on heads:
+   *
+   *   switch(expression.getHead().getHash()) {
+   *     case "Select"_.getHash(): ...
+   *   }
+   *
+   * Two heads with colliding hashes would result in duplicate case labels (i.e., a compile error)
+   */
+  constexpr ::std::uint64_t getHash() const { return hash; }
+  constexpr ::std::string_view getName() const { return name; }
+
+  /**
+   * A builder that allocates the arguments of the expressions it builds from resource, e.g., a
+   * std::pmr::monotonic_buffer_resource to allocate (and release) a whole plan at once. Note that
+   * the arguments of subexpressions are allocated by their own builders (and strings by the
+   * default allocator). The resource must outlive the expressions
+   */
+  constexpr ExtensibleExpressionBuilder
+  allocatingFrom(::std::pmr::memory_resource& resource) const {
+    auto result = *this;
+    result.resource = &resource;
+    return result;
+  }
   /**
    * This thing is a bit hacky: when construction Expression, some standard
    * libraries convert char const* to int or bool, not to ::std::string -- so I do
@@ -50,7 +97,7 @@ public:
   ::std::enable_if_t<sizeof...(Ts) == 0 || std::disjunction_v<isDynamicArgument<Ts>...>,
                      typename ExpressionSystem::ComplexExpression>
   operator()(Ts&&... args /*a*/) const {
-    typename ExpressionSystem::ExpressionArguments argList;
+    typename ExpressionSystem::ExpressionArguments argList(memoryResource());
     argList.reserve(sizeof...(Ts));
     (argList.push_back(convertConstCharToStringAndOnToExpression(
          ::std::forward<decltype(args)>(args))), // NOLINT(hicpp-no-array-decay)
@@ -62,7 +109,7 @@ public:
    * build expression from dynamic arguments (or no arguments)
    */
   typename ExpressionSystem::ComplexExpression operator()(typename ExpressionSystem::ExpressionArguments&& argList /*a*/) const {
-    return {s, {}, ::std::move(argList)};
+    return {symbol(), {}, ::std::move(argList)};
   }
 
   /**
@@ -76,7 +123,7 @@ public:
                      typename ExpressionSystem::template ComplexExpressionWithStaticArguments<
                          ::std::decay_t<Ts>...>>
   operator()(Ts&&... args /*a*/) const {
-    return {s, ::std::tuple<::std::decay_t<Ts>...>(::std::forward<Ts>(args)...)};
+    return {symbol(), ::std::tuple<::std::decay_t<Ts>...>(::std::forward<Ts>(args)...)};
   };
 
   /**
@@ -90,7 +137,10 @@ public:
     auto spans = std::array{
         std::forward<Ts>(args)...}; // unfortunately, vectors cannot be initialized with move-only
                                     // types which is why we need to put spans into an array first
-    return {s, {}, {}, {std::move_iterator(begin(spans)), std::move_iterator(end(spans))}};
+    return {symbol(),
+            {},
+            {},
+            {std::move_iterator(begin(spans)), std::move_iterator(end(spans)), memoryResource()}};
   }
 
   friend typename ExpressionSystem::Expression
@@ -98,11 +148,15 @@ public:
             ExtensibleExpressionBuilder const& builder) {
     return builder(expression);
   };
-  operator Symbol() const { return Symbol(s); } // NOLINT
+  operator Symbol() const { return symbol(); } // NOLINT
 };
 using ExpressionBuilder = ExtensibleExpressionBuilder<>;
-static ExpressionBuilder operator""_(const char* name, size_t /*unused*/) {
-  return ExpressionBuilder(name);
+/**
+ * constexpr so that the name's hash is computed at compile time (see
+ * ExtensibleExpressionBuilder::getHash)
+ */
+constexpr ExpressionBuilder operator""_(const char* name, size_t length) {
+  return ExpressionBuilder(name, length);
 };
 
 namespace experimental {
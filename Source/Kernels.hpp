@@ -0,0 +1,256 @@
+#pragma once
+
+#include "CompressedSpans.hpp"
+#include "Expression.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+/**
+ * Word-at-a-time kernels on the packed bitmaps of spans of bools (e.g., the results of predicates).
+ * All of them accept spans of bools as well as spans of const bools. Predicates on compressed
+ * spans produce such bitmaps without decoding the values
+ */
+namespace boss::kernels {
+using expressions::FrameOfReferenceSpan;
+using expressions::RunLengthSpan;
+using expressions::Span;
+
+namespace bitmap {
+constexpr auto bitsPerWord = size_t{64};
+
+inline size_t countBits(std::uint64_t word) {
+#if defined(_MSC_VER)
+  return __popcnt64(word);
+#else
+  return __builtin_popcountll(word);
+#endif
+}
+
+inline size_t countTrailingZeros(std::uint64_t word) {
+#if defined(_MSC_VER)
+  unsigned long index; // NOLINT(google-runtime-int)
+  _BitScanForward64(&index, word);
+  return index;
+#else
+  return __builtin_ctzll(word);
+#endif
+}
+
+inline size_t numberOfWords(size_t bits) { return (bits + bitsPerWord - 1) / bitsPerWord; }
+
+/**
+ * the index-th word of the bitmap (bits past the end of the span are zero)
+ */
+template <typename Bitmap> std::uint64_t loadWord(Bitmap const& bitmap, size_t index) {
+  auto const offset = index * bitsPerWord;
+  return (bitmap.begin() + offset).loadWord(std::min(bitsPerWord, bitmap.size() - offset));
+}
+
+/**
+ * the mask selecting the bits of the last word of a bitmap that are part of it
+ */
+inline std::uint64_t lastWordMask(size_t bits) {
+  return bits % bitsPerWord == 0 ? ~std::uint64_t{} : (std::uint64_t{1} << bits % bitsPerWord) - 1;
+}
+
+/**
+ * sets the bits [begin, end) of the bitmap
+ */
+inline void setBits(std::vector<std::uint64_t>& words, size_t begin, size_t end) {
+  for(auto i = begin; i < end;) {
+    auto const bits = std::min(bitsPerWord - i % bitsPerWord, end - i);
+    auto const mask = bits == bitsPerWord ? ~std::uint64_t{} : (std::uint64_t{1} << bits) - 1;
+    words[i / bitsPerWord] |= mask << (i % bitsPerWord);
+    i += bits;
+  }
+}
+
+template <bool NegateRight, typename Left, typename Right>
+Span<bool> combine(Left const& left, Right const& right) {
+  if(left.size() != right.size()) {
+    throw std::invalid_argument("cannot combine bitmaps of different sizes (" +
+                                std::to_string(left.size()) + " and " +
+                                std::to_string(right.size()) + ")");
+  }
+  auto result = std::vector<std::uint64_t>(numberOfWords(left.size()));
+  auto i = size_t{};
+  if(left.bitOffset() == 0 && right.bitOffset() == 0) {
+    auto const* leftWords = left.words();
+    auto const* rightWords = right.words();
+#if defined(__AVX2__)
+    constexpr auto wordsPerVector = sizeof(__m256i) / sizeof(std::uint64_t);
+    for(; i + wordsPerVector <= result.size(); i += wordsPerVector) {
+      // NOLINTBEGIN(cppcoreguidelines-pro-type-reinterpret-cast)
+      auto const leftVector = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(leftWords + i));
+      auto const rightVector = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(rightWords + i));
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(result.data() + i),
+                          NegateRight ? _mm256_andnot_si256(rightVector, leftVector)
+                                      : _mm256_and_si256(leftVector, rightVector));
+      // NOLINTEND(cppcoreguidelines-pro-type-reinterpret-cast)
+    }
+#endif
+    for(; i < result.size(); i++) {
+      result[i] = leftWords[i] & (NegateRight ? ~rightWords[i] : rightWords[i]);
+    }
+  } else {
+    for(; i < result.size(); i++) {
+      auto const rightWord = loadWord(right, i);
+      result[i] = loadWord(left, i) & (NegateRight ? ~rightWord : rightWord);
+    }
+  }
+  if(!result.empty()) {
+    result.back() &= lastWordMask(left.size());
+  }
+  return Span<bool>::fromBitmap(std::move(result), left.size());
+}
+} // namespace bitmap
+
+/**
+ * the number of set bits
+ */
+template <typename Bitmap> size_t popcount(Bitmap const& bitmap) {
+  auto const words = bitmap::numberOfWords(bitmap.size());
+  auto result = size_t{};
+  if(bitmap.bitOffset() == 0 && words > 0) {
+    auto const* data = bitmap.words();
+    for(auto i = size_t{}; i + 1 < words; i++) {
+      result += bitmap::countBits(data[i]);
+    }
+    return result + bitmap::countBits(data[words - 1] & bitmap::lastWordMask(bitmap.size()));
+  }
+  for(auto i = size_t{}; i < words; i++) {
+    result += bitmap::countBits(bitmap::loadWord(bitmap, i));
+  }
+  return result;
+}
+
+/**
+ * the number of null values of a (nullable) span
+ */
+template <typename Scalar> size_t nullCount(Span<Scalar> const& span) {
+  auto const* validity = span.getValidity();
+  return validity == nullptr ? 0 : span.size() - popcount(*validity);
+}
+
+/**
+ * left & right (the bitmaps must have the same size)
+ */
+template <typename Left, typename Right>
+Span<bool> bitwiseAnd(Left const& left, Right const& right) {
+  return bitmap::combine<false>(left, right);
+}
+
+/**
+ * left & ~right (the bitmaps must have the same size)
+ */
+template <typename Left, typename Right>
+Span<bool> bitwiseAndNot(Left const& left, Right const& right) {
+  return bitmap::combine<true>(left, right);
+}
+
+/**
+ * the (ascending) positions of the set bits, e.g., to turn the result of a predicate into a
+ * selection vector
+ */
+template <typename Bitmap> Span<std::int64_t> selectToIndex(Bitmap const& bitmap) {
+  auto result = std::vector<std::int64_t>();
+  result.reserve(popcount(bitmap));
+  for(auto i = size_t{}; i < bitmap::numberOfWords(bitmap.size()); i++) {
+    for(auto word = bitmap::loadWord(bitmap, i); word != 0; word &= word - 1) {
+      result.push_back(
+          static_cast<std::int64_t>(i * bitmap::bitsPerWord + bitmap::countTrailingZeros(word)));
+    }
+  }
+  return Span<std::int64_t>(std::move(result));
+}
+
+/**
+ * low <= value <= high, evaluated on the offsets from the reference (the values are not decoded):
+ * the bounds are translated into offsets once and every offset is checked with a single unsigned
+ * comparison. The bitmap is produced a word at a time; with AVX2, offsets of at most 32 bits are
+ * unpacked and compared eight at a time
+ */
+template <typename Integer>
+Span<bool> between(FrameOfReferenceSpan<Integer> const& span, std::common_type_t<Integer> low,
+                   std::common_type_t<Integer> high) {
+  auto result = std::vector<std::uint64_t>(bitmap::numberOfWords(span.size()));
+  auto const reference = span.getReference();
+  using Unsigned = std::make_unsigned_t<Integer>;
+  auto const lowOffset = low <= reference ? 0 : std::uint64_t(Unsigned(low) - Unsigned(reference));
+  // no offset can be selected if the bounds are empty or beyond the range of the offsets
+  if(low <= high && high >= reference && lowOffset <= span.mask()) {
+    // clamping the range to the largest possible offset keeps it within the bits of an offset
+    auto const range = std::min(std::uint64_t(Unsigned(high) - Unsigned(reference)) - lowOffset,
+                                span.mask() - lowOffset);
+    auto const bitWidth = span.getBitWidth();
+    auto const mask = span.mask();
+    auto const* words = span.getWords().begin();
+#if defined(__AVX2__)
+    auto const lowOffsets = _mm256_set1_epi32(static_cast<int>(lowOffset));
+    auto const ranges = _mm256_set1_epi32(static_cast<int>(range));
+#endif
+    auto bitIndex = size_t{}; // of the next offset in the packed words
+    for(auto i = size_t{}; i < result.size(); i++) {
+      auto const end = std::min(bitmap::bitsPerWord, span.size() - i * bitmap::bitsPerWord);
+      auto word = std::uint64_t{};
+      auto bit = size_t{};
+#if defined(__AVX2__)
+      if(bitWidth <= 32) {
+        for(; bit + 8 <= end; bit += 8, bitIndex += 8 * bitWidth) {
+          // (offset - lowOffset) <= range as an unsigned comparison
+          auto const offsets =
+              _mm256_sub_epi32(span.loadOffsets32(i * bitmap::bitsPerWord + bit), lowOffsets);
+          auto const selected = _mm256_cmpeq_epi32(_mm256_min_epu32(offsets, ranges), offsets);
+          auto const bits = _mm256_movemask_ps(_mm256_castsi256_ps(selected));
+          word |= std::uint64_t(static_cast<unsigned>(bits)) << bit;
+        }
+      }
+#endif
+      for(; bit < end; bit++, bitIndex += bitWidth) {
+        auto const shift = bitIndex % bitmap::bitsPerWord;
+        auto const* packed = words + bitIndex / bitmap::bitsPerWord;
+        auto offset = packed[0] >> shift;
+        if(shift + bitWidth > bitmap::bitsPerWord) {
+          offset |= packed[1] << (bitmap::bitsPerWord - shift);
+        }
+        word |= std::uint64_t{((offset & mask) - lowOffset) <= range} << bit;
+      }
+      result[i] = word;
+    }
+  }
+  return Span<bool>::fromBitmap(std::move(result), span.size());
+}
+
+/**
+ * low <= value <= high, evaluated once per run
+ */
+template <typename Integer>
+Span<bool> between(RunLengthSpan<Integer> const& span, std::common_type_t<Integer> low,
+                   std::common_type_t<Integer> high) {
+  auto result = std::vector<std::uint64_t>(bitmap::numberOfWords(span.size()));
+  for(auto run = size_t{}; run < span.runCount(); run++) {
+    auto const value = span.getValues()[run];
+    if(low <= value && value <= high) {
+      bitmap::setBits(result, span.runBegin(run), span.getRunEnds()[run]);
+    }
+  }
+  return Span<bool>::fromBitmap(std::move(result), span.size());
+}
+
+/**
+ * value == constant (the constant is converted to the type of the values)
+ */
+template <template <typename> class CompressedSpan, typename Integer>
+Span<bool> equal(CompressedSpan<Integer> const& span, std::common_type_t<Integer> constant) {
+  return between(span, constant, constant);
+}
+} // namespace boss::kernels
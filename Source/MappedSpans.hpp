@@ -0,0 +1,162 @@
+#pragma once
+
+#include "Expression.hpp"
+
+#ifndef _WIN32
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#define NOMINMAX // max macro in minwindef.h interfering with std::max...
+#include <windows.h>
+#endif
+
+#include <cstddef>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+namespace boss::expressions {
+namespace mapping {
+/**
+ * The owner of a span over a memory-mapped file (the mapping has to be unmapped as a whole)
+ */
+struct FileMapping {
+  void* address;
+  size_t length;
+};
+
+inline void unmap(void* owner) {
+  auto* mapping = static_cast<FileMapping*>(owner);
+#ifndef _WIN32
+  ::munmap(mapping->address, mapping->length);
+#else
+  ::UnmapViewOfFile(mapping->address);
+#endif
+  delete mapping; // NOLINT(cppcoreguidelines-owning-memory)
+}
+
+inline std::string lastError() {
+#ifndef _WIN32
+  return std::strerror(errno); // NOLINT(concurrency-mt-unsafe)
+#else
+  return std::to_string(::GetLastError());
+#endif
+}
+
+inline size_t mappingGranularity() {
+#ifndef _WIN32
+  return static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+#else
+  auto info = SYSTEM_INFO{};
+  ::GetSystemInfo(&info);
+  return info.dwAllocationGranularity;
+#endif
+}
+} // namespace mapping
+
+/**
+ * Creates a span directly over (a part of) a file that is mapped into memory -- the file is not
+ * read until the values are accessed and the pages are shared with all other processes mapping the
+ * file. The region is unmapped when the span is destroyed. The region starts offset bytes into the
+ * file and holds size values (by default, all remaining values in the file). The offset has to be
+ * a multiple of the alignment of the values (an invalid_argument exception is thrown otherwise).
+ *
+ * Spans of const values map the file read-only. Spans of non-const values map it copy-on-write:
+ * the values can be modified but the modifications are private to the span (they are not written
+ * back to the file).
+ */
+template <typename T>
+Span<T> mapFile(std::string const& path, size_t offset = 0, std::optional<size_t> size = {}) {
+  using Value = std::remove_const_t<T>;
+  static_assert(std::is_arithmetic_v<Value> && !std::is_same_v<Value, bool>,
+                "only spans of numeric values can be mapped from files");
+  constexpr auto readOnly = std::is_const_v<T>;
+  if(offset % alignof(Value) != 0) {
+    throw std::invalid_argument("values at offset " + std::to_string(offset) + " of file \"" +
+                                path + "\" are not aligned to " +
+                                std::to_string(alignof(Value)) + " bytes");
+  }
+
+#ifndef _WIN32
+  auto file = ::open(path.c_str(), O_RDONLY); // NOLINT(cppcoreguidelines-pro-type-vararg)
+  if(file < 0) {
+    throw std::runtime_error("file \"" + path + "\" could not be opened: " + mapping::lastError());
+  }
+  struct stat status = {};
+  if(::fstat(file, &status) != 0) {
+    ::close(file);
+    throw std::runtime_error("file \"" + path + "\" could not be accessed: " +
+                             mapping::lastError());
+  }
+  auto const fileSize = static_cast<size_t>(status.st_size);
+#else
+  auto file = ::CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL, nullptr);
+  if(file == INVALID_HANDLE_VALUE) {
+    throw std::runtime_error("file \"" + path + "\" could not be opened: " + mapping::lastError());
+  }
+  auto status = LARGE_INTEGER{};
+  if(::GetFileSizeEx(file, &status) == 0) {
+    auto const error = mapping::lastError();
+    ::CloseHandle(file);
+    throw std::runtime_error("file \"" + path + "\" could not be accessed: " + error);
+  }
+  auto const fileSize = static_cast<size_t>(status.QuadPart);
+#endif
+
+  auto const values = size.value_or(offset < fileSize ? (fileSize - offset) / sizeof(Value) : 0);
+  if(offset + values * sizeof(Value) > fileSize) {
+#ifndef _WIN32
+    ::close(file);
+#else
+    ::CloseHandle(file);
+#endif
+    throw std::out_of_range("file \"" + path + "\" has no " + std::to_string(values) +
+                            " values at offset " + std::to_string(offset));
+  }
+  if(values == 0) {
+#ifndef _WIN32
+    ::close(file);
+#else
+    ::CloseHandle(file);
+#endif
+    return Span<T>();
+  }
+
+  // mappings have to start at a multiple of the page size (or allocation granularity)
+  auto const mappingOffset = offset / mapping::mappingGranularity() * mapping::mappingGranularity();
+  auto const length = offset - mappingOffset + values * sizeof(Value);
+#ifndef _WIN32
+  auto* address = ::mmap(nullptr, length, readOnly ? PROT_READ : PROT_READ | PROT_WRITE,
+                         readOnly ? MAP_SHARED : MAP_PRIVATE, file, // NOLINT(hicpp-signed-bitwise)
+                         static_cast<off_t>(mappingOffset));
+  ::close(file); // the mapping keeps the file open
+  if(address == MAP_FAILED) { // NOLINT(cppcoreguidelines-pro-type-cstyle-cast)
+    throw std::runtime_error("file \"" + path + "\" could not be mapped: " + mapping::lastError());
+  }
+#else
+  auto* fileMapping = ::CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  ::CloseHandle(file);
+  auto* address = fileMapping == nullptr
+                      ? nullptr
+                      : ::MapViewOfFile(fileMapping, readOnly ? FILE_MAP_READ : FILE_MAP_COPY,
+                                        static_cast<DWORD>(mappingOffset >> 32U),
+                                        static_cast<DWORD>(mappingOffset), length);
+  if(fileMapping != nullptr) {
+    ::CloseHandle(fileMapping); // the view keeps the mapping alive
+  }
+  if(address == nullptr) {
+    throw std::runtime_error("file \"" + path + "\" could not be mapped: " + mapping::lastError());
+  }
+#endif
+
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+  auto* begin = reinterpret_cast<T*>(static_cast<char*>(address) + (offset - mappingOffset));
+  return Span<T>(begin, values, new mapping::FileMapping{address, length}, &mapping::unmap);
+}
+} // namespace boss::expressions
@@ -5,11 +5,14 @@
 #include <cstdlib>
 #include <inttypes.h>
 #include <iterator>
+#include <memory_resource>
 #include <optional>
 #include <string.h>
+#include <string>
 #include <type_traits>
 #include <utility>
 #include <variant>
+#include <vector>
 extern "C" {
 #include "PortableBOSSSerialization.h"
 }
@@ -64,59 +67,42 @@ struct SerializedExpression {
 
   //////////////////////////////// Count Arguments ///////////////////////////////
 
-  template <typename TupleLike, uint64_t... Is>
-  static uint64_t countArgumentsInTuple(TupleLike const& tuple,
-                                        std::index_sequence<Is...> /*unused*/) {
-    return (countArguments(std::get<Is>(tuple)) + ... + 0);
-  };
+  /**
+   * calls visitor(expression) for all complex (sub-)expressions of input, using an explicit stack
+   * instead of recursion (deep expressions would overflow the call stack)
+   */
+  template <typename Visitor>
+  static void forEachComplexExpression(boss::Expression const& input, Visitor&& visitor) {
+    auto pending = std::vector<boss::ComplexExpression const*>();
+    if(auto const* complex = std::get_if<boss::ComplexExpression>(&input)) {
+      pending.push_back(complex);
+    }
+    while(!pending.empty()) {
+      auto const* expression = pending.back();
+      pending.pop_back();
+      visitor(*expression);
+      for(auto const& argument : expression->getDynamicArguments()) {
+        if(auto const* complex = std::get_if<boss::ComplexExpression>(&argument)) {
+          pending.push_back(complex);
+        }
+      }
+    }
+  }
 
   static uint64_t countArguments(boss::Expression const& input) {
-    return std::visit(
-        [](auto& input) -> size_t {
-          if constexpr(std::is_same_v<std::decay_t<decltype(input)>, boss::ComplexExpression>) {
-            return 1 +
-                   countArgumentsInTuple(
-                       input.getStaticArguments(),
-                       std::make_index_sequence<std::tuple_size_v<
-                           std::decay_t<decltype(input.getStaticArguments())>>>()) +
-                   std::accumulate(input.getDynamicArguments().begin(),
-                                   input.getDynamicArguments().end(), 0,
-                                   [](auto runningSum, auto const& argument) {
-                                     return runningSum + countArguments(argument);
-                                   }) +
-                   input.getSpanArguments().size();
-          }
-          return 1;
-        },
-        input);
+    auto result = uint64_t{1};
+    forEachComplexExpression(input, [&result](boss::ComplexExpression const& expression) {
+      result += expression.getDynamicArguments().size() + expression.getSpanArguments().size();
+    });
+    return result;
   }
 
   //////////////////////////////// Count Expressions ///////////////////////////////
 
-  template <typename TupleLike, uint64_t... Is>
-  static uint64_t countExpressionsInTuple(TupleLike const& tuple,
-                                          std::index_sequence<Is...> /*unused*/) {
-    return (countExpressions(std::get<Is>(tuple)) + ... + 0);
-  };
-
-  template <typename T> static uint64_t countExpressions(T const& /*unused*/) { return 0; }
-
   static uint64_t countExpressions(boss::Expression const& input) {
-    return std::visit(utilities::overload(
-                          [](boss::ComplexExpression const& input) -> uint64_t {
-                            return 1 +
-                                   countExpressionsInTuple(
-                                       input.getStaticArguments(),
-                                       std::make_index_sequence<std::tuple_size_v<
-                                           std::decay_t<decltype(input.getStaticArguments())>>>()) +
-                                   std::accumulate(input.getDynamicArguments().begin(),
-                                                   input.getDynamicArguments().end(), 0,
-                                                   [](auto runningSum, auto const& argument) {
-                                                     return runningSum + countExpressions(argument);
-                                                   });
-                          },
-                          [](auto const&) -> uint64_t { return 0; }),
-                      input);
+    auto result = uint64_t{};
+    forEachComplexExpression(input, [&result](auto const& /*expression*/) { result++; });
+    return result;
   }
 
   //////////////////////////////   Flatten Arguments /////////////////////////////
@@ -127,8 +113,13 @@ struct SerializedExpression {
     (flattenArguments(std::get<Is>(tuple), argumentOutputI), ...);
   };
 
-  uint64_t flattenArguments(uint64_t argumentOutputI, std::vector<boss::ComplexExpression>&& inputs,
-                            uint64_t& expressionOutputI) {
+  /**
+   * flattens the arguments of the expressions of one layer of the tree and returns the complex
+   * arguments (the next layer)
+   */
+  std::vector<boss::ComplexExpression> flattenLayer(uint64_t& argumentOutputI,
+                                                    std::vector<boss::ComplexExpression>&& inputs,
+                                                    uint64_t& expressionOutputI) {
     auto const nextLayerOffset =
         argumentOutputI +
         std::accumulate(inputs.begin(), inputs.end(), 0, [](auto count, auto const& expression) {
@@ -208,8 +199,16 @@ struct SerializedExpression {
                     std::forward<decltype(argument)>(argument));
               });
         });
-    if(!children.empty()) {
-      return flattenArguments(argumentOutputI, std::move(children), expressionOutputI);
+    return children;
+  }
+
+  /**
+   * flattens the arguments layer by layer (breadth-first, without recursion)
+   */
+  uint64_t flattenArguments(uint64_t argumentOutputI, std::vector<boss::ComplexExpression>&& inputs,
+                            uint64_t& expressionOutputI) {
+    for(auto layer = std::move(inputs); !layer.empty();) {
+      layer = flattenLayer(argumentOutputI, std::move(layer), expressionOutputI);
     }
     return argumentOutputI;
   }
@@ -256,35 +255,76 @@ public:
 
   explicit SerializedExpression(RootExpression* root) : root(root) {}
 
-  boss::expressions::ExpressionArguments deserializeArguments(uint64_t startChildOffset,
-                                                              uint64_t endChildOffset) {
-    boss::expressions::ExpressionArguments arguments;
-    for(auto childIndex = startChildOffset; childIndex < endChildOffset; childIndex++) {
+  /**
+   * Deserializes the arguments in [startChildOffset, endChildOffset) with an explicit stack of the
+   * subexpressions whose arguments are being deserialized (deep expressions would overflow the
+   * call stack otherwise)
+   */
+  boss::expressions::ExpressionArguments
+  deserializeArguments(uint64_t startChildOffset, uint64_t endChildOffset,
+                       std::pmr::memory_resource* resource = std::pmr::get_default_resource()) {
+    struct Frame {
+      std::optional<boss::Symbol> head; // none for the arguments that are returned
+      uint64_t nextChildOffset;
+      uint64_t endChildOffset;
+      boss::expressions::ExpressionArguments arguments;
+    };
+    auto frames = std::vector<Frame>();
+    frames.push_back({{}, startChildOffset, endChildOffset,
+                      boss::expressions::ExpressionArguments(resource)});
+    frames.back().arguments.reserve(endChildOffset - startChildOffset);
+    while(true) {
+      auto& frame = frames.back();
+      if(frame.nextChildOffset == frame.endChildOffset) {
+        if(frames.size() == 1) {
+          return std::move(frame.arguments);
+        }
+        auto result = boss::expressions::ComplexExpression(std::move(*frame.head),
+                                                           std::move(frame.arguments));
+        frames.pop_back();
+        frames.back().arguments.emplace_back(std::move(result));
+        continue;
+      }
+      auto const childIndex = frame.nextChildOffset++;
       auto const& arg = flattenedArguments()[childIndex];
-      auto const& type = flattenedArgumentTypes()[childIndex];
-      auto const functors = std::unordered_map<ArgumentType, std::function<boss::Expression()>>{
-          {ArgumentType::ARGUMENT_TYPE_BOOL, [&] { return (arg.asBool); }},
-          {ArgumentType::ARGUMENT_TYPE_CHAR, [&] { return (arg.asChar); }},
-          {ArgumentType::ARGUMENT_TYPE_INT, [&] { return (arg.asInt); }},
-          {ArgumentType::ARGUMENT_TYPE_LONG, [&] { return (arg.asLong); }},
-          {ArgumentType::ARGUMENT_TYPE_FLOAT, [&] { return (arg.asFloat); }},
-          {ArgumentType::ARGUMENT_TYPE_DOUBLE, [&] { return (arg.asDouble); }},
-          {ArgumentType::ARGUMENT_TYPE_SYMBOL,
-           [&arg, this] { return boss::Symbol(viewString(root, arg.asString)); }},
-          {ArgumentType::ARGUMENT_TYPE_EXPRESSION,
-           [&arg, this]() -> boss::Expression {
-             auto result = boss::expressions::ComplexExpression(
-                 boss::Symbol(
-                     viewString(root, expressionsBuffer()[arg.asExpression].symbolNameOffset)),
-                 deserializeArguments(expressionsBuffer()[arg.asExpression].startChildOffset,
-                                      expressionsBuffer()[arg.asExpression].endChildOffset));
-             return result;
-           }},
-          {ArgumentType::ARGUMENT_TYPE_STRING,
-           [&arg, this] { return std::string(viewString(root, arg.asString)); }}};
-      arguments.push_back(functors.at(type)());
+      switch(flattenedArgumentTypes()[childIndex]) {
+      case ArgumentType::ARGUMENT_TYPE_BOOL:
+        frame.arguments.emplace_back(arg.asBool);
+        break;
+      case ArgumentType::ARGUMENT_TYPE_CHAR:
+        frame.arguments.emplace_back(arg.asChar);
+        break;
+      case ArgumentType::ARGUMENT_TYPE_INT:
+        frame.arguments.emplace_back(arg.asInt);
+        break;
+      case ArgumentType::ARGUMENT_TYPE_LONG:
+        frame.arguments.emplace_back(arg.asLong);
+        break;
+      case ArgumentType::ARGUMENT_TYPE_FLOAT:
+        frame.arguments.emplace_back(arg.asFloat);
+        break;
+      case ArgumentType::ARGUMENT_TYPE_DOUBLE:
+        frame.arguments.emplace_back(arg.asDouble);
+        break;
+      case ArgumentType::ARGUMENT_TYPE_SYMBOL:
+        frame.arguments.emplace_back(boss::Symbol(viewString(root, arg.asString)));
+        break;
+      case ArgumentType::ARGUMENT_TYPE_STRING:
+        frame.arguments.emplace_back(std::string(viewString(root, arg.asString)));
+        break;
+      case ArgumentType::ARGUMENT_TYPE_EXPRESSION: {
+        auto const& expression = expressionsBuffer()[arg.asExpression];
+        frames.push_back({boss::Symbol(viewString(root, expression.symbolNameOffset)),
+                          expression.startChildOffset, expression.endChildOffset,
+                          boss::expressions::ExpressionArguments(resource)});
+        frames.back().arguments.reserve(expression.endChildOffset - expression.startChildOffset);
+        break;
+      }
+      default:
+        throw std::out_of_range("cannot deserialize argument of type " +
+                                std::to_string(flattenedArgumentTypes()[childIndex]));
+      }
     }
-    return arguments;
   }
 
   template <typename... Types> class variant {
@@ -351,7 +391,11 @@ public:
 
   LazilyDeserializedExpression lazilyDeserialize() & { return {*this, 0}; };
 
-  boss::Expression deserialize() && {
+  /**
+   * the arguments of all complex expressions are allocated from resource (e.g., an arena)
+   */
+  boss::Expression
+  deserialize(std::pmr::memory_resource* resource = std::pmr::get_default_resource()) && {
     switch(flattenedArgumentTypes()[0]) {
     case ArgumentType::ARGUMENT_TYPE_BOOL:
       return flattenedArguments()[0].asBool;
@@ -375,7 +419,7 @@ public:
         return s;
       }
       auto result = boss::ComplexExpression{
-          s, deserializeArguments(1, expressionsBuffer()[0].endChildOffset)};
+          s, deserializeArguments(1, expressionsBuffer()[0].endChildOffset, resource)};
       return result;
     }
   };
@@ -0,0 +1,326 @@
+#pragma once
+
+#include "Expression.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <variant>
+#include <vector>
+
+/**
+ * Hash-consed expressions: an (optional) representation of expressions as DAGs of immutable nodes
+ * in which structurally equal subexpressions are stored once. Generated plans repeat subtrees
+ * (projections, predicates, column references) which are, thus, stored, hashed and evaluated once
+ * (see evaluateOnce)
+ */
+namespace boss::expressions {
+class SharedExpressionNode {
+public:
+  using Pointer = std::shared_ptr<SharedExpressionNode const>;
+  /**
+   * atoms are stored in the node, complex subexpressions are (shared) nodes
+   */
+  using Argument = std::variant<AtomicExpression, Pointer>;
+
+private:
+  Symbol head;
+  /**
+   * mutable only so that the destructor can detach the arguments of nodes that are released along
+   * with this one (see ~SharedExpressionNode)
+   */
+  mutable std::vector<Argument> arguments;
+  ExpressionSpanArguments spanArguments;
+  std::uint64_t hash;
+
+  /**
+   * the same as ComplexExpression::hash of the materialized expression
+   */
+  std::uint64_t computeHash() const {
+    auto accumulator = hashing::Accumulator();
+    for(auto const& argument : arguments) {
+      std::visit(
+          boss::utilities::overload(
+              [&accumulator](Pointer const& node) { accumulator.addComplex(node->getHash()); },
+              [&accumulator](AtomicExpression const& atom) {
+                std::visit([&accumulator](auto const& atom) { accumulator.addAtom(atom); }, atom);
+              }),
+          argument);
+    }
+    for(auto const& spanArgument : spanArguments) {
+      std::visit([&accumulator](auto const& span) { accumulator.addSpan(span); }, spanArgument);
+    }
+    return accumulator.finish(head);
+  }
+
+public:
+  /**
+   * The spans are shared (see Span::share) so that materializing the node does not copy them
+   */
+  SharedExpressionNode(Symbol const& head, std::vector<Argument>&& arguments,
+                       ExpressionSpanArguments&& spanArguments = {})
+      : head(head), arguments(std::move(arguments)) {
+    this->spanArguments.reserve(spanArguments.size());
+    for(auto& spanArgument : spanArguments) {
+      std::visit(
+          [this](auto&& span) { this->spanArguments.emplace_back(std::move(span).share()); },
+          std::move(spanArgument));
+    }
+    hash = computeHash();
+  }
+  SharedExpressionNode(SharedExpressionNode const&) = delete;
+  SharedExpressionNode(SharedExpressionNode&&) = delete;
+  SharedExpressionNode& operator=(SharedExpressionNode const&) = delete;
+  SharedExpressionNode& operator=(SharedExpressionNode&&) = delete;
+
+  /**
+   * Releases the subexpressions without recursion: the arguments of nodes that are only referenced
+   * by the node that is released are detached (and released by this destructor) first
+   */
+  ~SharedExpressionNode() {
+    auto pending = std::vector<Pointer>();
+    auto detachArguments = [&pending](SharedExpressionNode const& node) {
+      for(auto& argument : node.arguments) {
+        if(auto* child = std::get_if<Pointer>(&argument); child != nullptr && *child) {
+          pending.push_back(std::move(*child));
+        }
+      }
+      node.arguments.clear();
+    };
+    detachArguments(*this);
+    while(!pending.empty()) {
+      auto node = std::move(pending.back());
+      pending.pop_back();
+      if(node.use_count() == 1) {
+        detachArguments(*node);
+      }
+    }
+  }
+
+  Symbol const& getHead() const { return head; }
+  std::vector<Argument> const& getArguments() const { return arguments; }
+  ExpressionSpanArguments const& getSpanArguments() const { return spanArguments; }
+  std::uint64_t getHash() const { return hash; }
+
+  /**
+   * true if the nodes have the same head and arguments. Complex arguments are compared by identity
+   * (which is structural equality for nodes of the same HashConsingFactory)
+   */
+  bool hasSameStructure(SharedExpressionNode const& other) const {
+    if(hash != other.hash || head != other.head || arguments != other.arguments ||
+       spanArguments.size() != other.spanArguments.size()) {
+      return false;
+    }
+    for(auto i = size_t{}; i < spanArguments.size(); i++) {
+      auto const equal = std::visit(
+          [&other, i](auto const& span) {
+            auto const* otherSpan =
+                std::get_if<std::decay_t<decltype(span)>>(&other.spanArguments[i]);
+            return otherSpan != nullptr && hashing::spanValuesEqual(span, *otherSpan);
+          },
+          spanArguments[i]);
+      if(!equal) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /**
+   * Builds the (tree-shaped) expression, i.e., shared subexpressions are materialized once per
+   * use. Spans are not copied (use ComplexExpression::makeWritable before writing to the values).
+   * Subexpressions are materialized bottom-up with an explicit stack
+   */
+  ComplexExpression toExpression() const {
+    struct Frame {
+      SharedExpressionNode const* node;
+      ExpressionArguments materializedArguments;
+    };
+    auto frames = std::vector<Frame>();
+    frames.push_back({this, {}});
+    frames.back().materializedArguments.reserve(arguments.size());
+    while(true) {
+      auto& [node, materializedArguments] = frames.back();
+      if(materializedArguments.size() < node->arguments.size()) {
+        auto const& argument = node->arguments[materializedArguments.size()];
+        if(auto const* child = std::get_if<Pointer>(&argument)) {
+          frames.push_back({child->get(), {}});
+          frames.back().materializedArguments.reserve((*child)->arguments.size());
+        } else {
+          std::visit([&](auto const& atom) { materializedArguments.emplace_back(atom); },
+                     std::get<AtomicExpression>(argument));
+        }
+        continue;
+      }
+      auto materializedSpans = ExpressionSpanArguments();
+      materializedSpans.reserve(node->spanArguments.size());
+      for(auto const& spanArgument : node->spanArguments) {
+        std::visit(
+            [&](auto const& span) {
+              materializedSpans.emplace_back(span.clone(CloneReason::SHARED_EXPRESSION));
+            },
+            spanArgument);
+      }
+      auto expression = ComplexExpression(node->head, {}, std::move(materializedArguments),
+                                          std::move(materializedSpans));
+      frames.pop_back();
+      if(frames.empty()) {
+        return expression;
+      }
+      frames.back().materializedArguments.emplace_back(std::move(expression));
+    }
+  }
+};
+
+/**
+ * Interns expressions into shared nodes: structurally equal (sub-)expressions that are interned by
+ * the same factory become the same node. The factory does not keep nodes alive (the entries of
+ * nodes that are no longer referenced are dropped from the table, see purge)
+ */
+class HashConsingFactory {
+  std::unordered_multimap<std::uint64_t, std::weak_ptr<SharedExpressionNode const>> nodes;
+  /**
+   * the number of entries after the last purge: the table is purged whenever it has doubled since,
+   * which keeps the cost of purging constant per interned node (amortized)
+   */
+  size_t entriesAfterPurge = 0;
+
+public:
+  /**
+   * the node with the head and arguments (the complex arguments need to have been interned by this
+   * factory)
+   */
+  SharedExpressionNode::Pointer make(Symbol const& head,
+                                     std::vector<SharedExpressionNode::Argument>&& arguments,
+                                     ExpressionSpanArguments&& spanArguments = {}) {
+    // not allocated with make_shared: the (weak) entries of the table would keep the storage of
+    // nodes that are no longer referenced alive
+    auto candidate = SharedExpressionNode::Pointer(new SharedExpressionNode( // NOLINT
+        head, std::move(arguments), std::move(spanArguments)));
+    auto [it, end] = nodes.equal_range(candidate->getHash());
+    while(it != end) {
+      if(auto node = it->second.lock()) {
+        if(node->hasSameStructure(*candidate)) {
+          return node;
+        }
+        ++it;
+      } else {
+        it = nodes.erase(it);
+      }
+    }
+    if(nodes.size() > 2 * entriesAfterPurge) {
+      purge();
+    }
+    nodes.emplace(candidate->getHash(), candidate);
+    return candidate;
+  }
+
+  /**
+   * drops the entries of nodes that are no longer referenced (called implicitly when nodes are
+   * interned)
+   */
+  void purge() {
+    for(auto it = nodes.begin(); it != nodes.end();) {
+      it = it->second.expired() ? nodes.erase(it) : std::next(it);
+    }
+    entriesAfterPurge = nodes.size();
+  }
+
+  /**
+   * interns the complex expression bottom-up with an explicit stack (the expression is consumed)
+   */
+  SharedExpressionNode::Pointer intern(ComplexExpression&& expression) {
+    struct Frame {
+      Symbol head;
+      ExpressionArguments dynamics;
+      ExpressionSpanArguments spans;
+      std::vector<SharedExpressionNode::Argument> arguments;
+    };
+    auto frames = std::vector<Frame>();
+    auto push = [&frames](ComplexExpression&& expression) {
+      auto [head, _unused, dynamics, spans] = std::move(expression).decompose();
+      frames.push_back({std::move(head), std::move(dynamics), std::move(spans), {}});
+      frames.back().arguments.reserve(frames.back().dynamics.size());
+    };
+    push(std::move(expression));
+    while(true) {
+      auto& frame = frames.back();
+      if(frame.arguments.size() < frame.dynamics.size()) {
+        auto& argument = frame.dynamics[frame.arguments.size()];
+        if(auto* complex = std::get_if<ComplexExpression>(&argument)) {
+          push(std::move(*complex));
+        } else {
+          std::visit(
+              [&frame](auto&& atom) {
+                using T = std::decay_t<decltype(atom)>;
+                if constexpr(!std::is_same_v<T, ComplexExpression>) {
+                  frame.arguments.emplace_back(AtomicExpression(std::move(atom)));
+                }
+              },
+              std::move(argument));
+        }
+        continue;
+      }
+      auto node = make(frame.head, std::move(frame.arguments), std::move(frame.spans));
+      frames.pop_back();
+      if(frames.empty()) {
+        return node;
+      }
+      frames.back().arguments.emplace_back(std::move(node));
+    }
+  }
+
+  /**
+   * the number of distinct nodes (that are still referenced)
+   */
+  size_t size() const {
+    return std::count_if(nodes.begin(), nodes.end(),
+                         [](auto const& entry) { return !entry.second.expired(); });
+  }
+  /**
+   * the number of entries of the table, including those of nodes that are no longer referenced
+   * (and have not been purged yet)
+   */
+  size_t tableSize() const { return nodes.size(); }
+};
+
+/**
+ * Evaluates a DAG of shared nodes bottom-up, evaluating every node once (no matter how often it is
+ * referenced). The visitor is called as visitor(node, evaluate) and gets the (memoized) Result of
+ * a complex argument with evaluate(argumentNode). The complex arguments of a node are evaluated
+ * before the node itself, with an explicit stack (so deep DAGs do not overflow the stack)
+ */
+template <typename Result, typename Visitor>
+Result evaluateOnce(SharedExpressionNode::Pointer const& root, Visitor&& visitor) {
+  auto results = std::unordered_map<SharedExpressionNode const*, Result>();
+  auto evaluate = std::function<Result const&(SharedExpressionNode::Pointer const&)>();
+  evaluate = [&results, &visitor, &evaluate](SharedExpressionNode::Pointer const& node)
+      -> Result const& {
+    auto pending = std::vector<SharedExpressionNode const*>{node.get()};
+    while(!pending.empty()) {
+      auto const* next = pending.back();
+      if(results.count(next) != 0) {
+        pending.pop_back();
+        continue;
+      }
+      auto const evaluatedArguments = pending.size();
+      for(auto const& argument : next->getArguments()) {
+        auto const* child = std::get_if<SharedExpressionNode::Pointer>(&argument);
+        if(child != nullptr && results.count(child->get()) == 0) {
+          pending.push_back(child->get());
+        }
+      }
+      if(pending.size() == evaluatedArguments) {
+        auto result = visitor(*next, evaluate);
+        results.emplace(next, std::move(result));
+        pending.pop_back();
+      }
+    }
+    return results.at(node.get());
+  };
+  evaluate(root);
+  return std::move(results.at(root.get()));
+}
+} // namespace boss::expressions
@@ -2,11 +2,20 @@
 #define CATCH_CONFIG_RUNNER
 #include "../Source/BOSS.hpp"
 #include "../Source/BootstrapEngine.hpp"
+#include "../Source/ChunkedColumn.hpp"
+#include "../Source/CompressedSpans.hpp"
 #include "../Source/ExpressionUtilities.hpp"
+#include "../Source/Kernels.hpp"
+#include "../Source/MappedSpans.hpp"
 #include "../Source/Serialization.hpp"
+#include "../Source/SharedExpressions.hpp"
 #include <array>
 #include <catch2/catch.hpp>
+#include <filesystem>
+#include <fstream>
+#include <memory_resource>
 #include <numeric>
+#include <thread>
 #include <variant>
 using boss::Expression;
 using std::string;
@@ -48,6 +57,58 @@ TEST_CASE("Subspans work correctly", "[spans]") {
   CHECK(subrange2[1] == 2);
 }
 
+TEST_CASE("Symbols are interned", "[symbols]") {
+  auto const select = boss::Symbol("Select");
+  CHECK(boss::Symbol("Select") == select);
+  CHECK(boss::Symbol("Select"s) == select);
+  CHECK(boss::Symbol("Select").getId() == select.getId());
+  CHECK(boss::Symbol("Project") != select);
+  CHECK(boss::Symbol("Project").getId() != select.getId());
+  CHECK(select.getName() == "Select");
+  CHECK(std::hash<boss::Symbol>{}(select) ==
+        boss::expressions::atoms::hashSymbolName("Select"));
+  CHECK(boss::expressions::atoms::SymbolTable::global().at(select.getId()).name == "Select");
+
+  SECTION("concurrent interning") {
+    auto const threadCount = 4;
+    auto const symbolCount = 100;
+    auto ids = std::vector<std::vector<uint32_t>>(threadCount);
+    auto threads = std::vector<std::thread>();
+    for(auto i = 0; i < threadCount; i++) {
+      threads.emplace_back([&ids, i, symbolCount]() {
+        for(auto j = 0; j < symbolCount; j++) {
+          ids[i].push_back(boss::Symbol("ConcurrentSymbol" + std::to_string(j)).getId());
+        }
+      });
+    }
+    for(auto& thread : threads) {
+      thread.join();
+    }
+    for(auto i = 1; i < threadCount; i++) {
+      CHECK(ids[i] == ids[0]);
+    }
+  }
+}
+
+TEST_CASE("Symbol literals are hashed at compile time", "[symbols]") {
+  static_assert("Select"_.getHash() == boss::expressions::atoms::hashSymbolName("Select"));
+  static_assert("Select"_.getHash() != "Project"_.getHash());
+  auto dispatch = [](boss::ComplexExpression const& e) {
+    switch(e.getHead().getHash()) {
+    case "Select"_.getHash():
+      return 1;
+    case "Project"_.getHash():
+      return 2;
+    default:
+      return 0;
+    }
+  };
+  CHECK(dispatch("Select"_("Table"_())) == 1);
+  CHECK(dispatch("Project"_("Table"_())) == 2);
+  CHECK(dispatch("Where"_("Table"_())) == 0);
+  CHECK(boss::Symbol("Select"_) == boss::Symbol("Select"));
+}
+
 TEST_CASE("Expressions", "[expressions]") {
   using SpanArguments = boss::expressions::ExpressionSpanArguments;
   using SpanArgument = boss::expressions::ExpressionSpanArgument;
@@ -112,6 +173,25 @@ TEST_CASE("Expressions with static Arguments", "[expressions]") {
     CHECK(e.getArguments().at(0) == v1);
     CHECK(e.getArguments().at(1) == v2);
   }
+  SECTION("Static, dynamic and span arguments") {
+    auto const e =
+        boss::ComplexExpressionWithStaticArguments<std::int64_t, double_t, boss::Symbol>(
+            "Row"_, {1, 2.5, "three"_}, boss::ExpressionArguments(int64_t{4}),
+            boss::expressions::ExpressionSpanArguments(boss::Span<int64_t>(vector<int64_t>{5})));
+    REQUIRE(e.getArguments().size() == 5);
+    CHECK(get<int64_t>(e.getArguments()[0]) == 1);
+    CHECK(get<double_t>(e.getArguments()[1]) == 2.5);
+    CHECK(get<boss::Symbol>(e.getArguments().at(2)) == "three"_);
+    CHECK(get<int64_t>(e.getArguments()[3]) == 4);
+    CHECK(get<int64_t>(e.getArguments()[4]) == 5);
+    auto sum = int64_t{};
+    for(auto const& argument : e.getArguments()) {
+      if(auto const* value = get_if<int64_t>(&argument)) {
+        sum += *value;
+      }
+    }
+    CHECK(sum == 10);
+  }
   SECTION("Complex subexpressions") {
     auto v1 = GENERATE(take(3, random<std::int64_t>(1, 100)));
     auto const e = boss::ComplexExpressionWithStaticArguments<
@@ -131,6 +211,158 @@ TEST_CASE("Expressions with static Arguments", "[expressions]") {
   }
 }
 
+TEST_CASE("Structural hashing and equality", "[expressions][hashing]") {
+  auto const hash = std::hash<boss::Expression>();
+  CHECK(hash(boss::Expression(1)) == hash(boss::Expression(int64_t{1})));
+  CHECK(hash(boss::Expression(1)) == hash(boss::Expression(1.0)));
+  CHECK(hash(boss::Expression("a"s)) != hash(boss::Expression("a"_)));
+  CHECK(hash("Plus"_(1, 2)) == hash("Plus"_(1, 2)));
+  CHECK(hash("Plus"_(1, 2)) != hash("Plus"_(2, 1)));
+  CHECK(hash("Plus"_(1, 2)) != hash("Minus"_(1, 2)));
+  CHECK(hash("Plus"_("Times"_(1, 2), 3)) != hash("Plus"_("Times"_(1, 3), 2)));
+
+  auto const values = vector<int64_t>{1, 2, 3};
+  auto const dynamic = ComplexExpression(
+      "Column"_, {}, boss::ExpressionArguments(values[0], values[1], values[2]), {});
+  auto const spans = ComplexExpression(
+      "Column"_, {}, {},
+      boss::expressions::ExpressionSpanArguments(boss::Span<int64_t const>(values)));
+  CHECK(dynamic.hash() == spans.hash()); // arguments are hashed independent of their storage
+
+  SECTION("Hashes are cached") {
+    auto expression = "Plus"_(1, 2);
+    CHECK_FALSE(expression.hasHash());
+    auto const first = expression.hash();
+    CHECK(expression.hasHash());
+    CHECK(expression.hash() == first);
+    get<int32_t>(expression.getArguments().at(1)) = 3;
+    CHECK_FALSE(expression.hasHash());
+    CHECK(expression.hash() == "Plus"_(1, 3).hash());
+    CHECK(expression.hash() != first);
+  }
+
+  auto node = [](boss::Symbol const& head, auto&&... arguments) {
+    return ComplexExpression(
+        head, boss::ExpressionArguments(std::forward<decltype(arguments)>(arguments)...));
+  };
+  SECTION("Mutable access to arguments resets the cached hash") {
+    auto nested = node("Plus"_, node("Times"_, int64_t{2}, int64_t{3}), int64_t{1});
+    auto const before = nested.hash();
+    auto& times = get<ComplexExpression>(nested.getArguments()[0]);
+    CHECK_FALSE(nested.hasHash());
+    get<int64_t>(times.getArguments()[0]) = 4;
+    CHECK(nested.hash() != before);
+    auto const expected = node("Plus"_, node("Times"_, int64_t{4}, int64_t{3}), int64_t{1});
+    CHECK(nested.hash() == expected.hash());
+  }
+
+  SECTION("Equality does not depend on stale cached hashes") {
+    auto times = [](int64_t factor) {
+      return ComplexExpression("Times"_, {}, {},
+                               boss::expressions::ExpressionSpanArguments(
+                                   boss::Span<int64_t>(vector<int64_t>{factor, 3})));
+    };
+    auto nested = node("Plus"_, times(2));
+    auto& product = get<ComplexExpression>(nested.getArguments()[0]);
+    nested.hash(); // the write below is not detected by the cache (see hash())
+    get<int64_t>(product.getArguments()[0]) = 4;
+    auto const expected = node("Plus"_, times(4));
+    CHECK(expected.hash() != nested.hash());
+    CHECK(nested.operator==(expected));
+  }
+
+  SECTION("Large spans") {
+    auto const size = 1U << 20U;
+    auto makeColumn = [size](int64_t last, double_t zero) {
+      auto integers = vector<int64_t>(size);
+      std::iota(integers.begin(), integers.end(), 0);
+      integers.back() = last;
+      auto doubles = vector<double_t>(size, zero);
+      return ComplexExpression("Table"_, {}, {},
+                               boss::expressions::ExpressionSpanArguments(
+                                   boss::Span<int64_t>(std::move(integers)),
+                                   boss::Span<double_t>(std::move(doubles))));
+    };
+    auto const table = makeColumn(size - 1, 0.0);
+    CHECK(table.operator==(makeColumn(size - 1, -0.0))); // 0.0 == -0.0 (but not bitwise)
+    CHECK_FALSE(table.operator==(makeColumn(0, 0.0)));
+    CHECK(table.hash() == makeColumn(size - 1, -0.0).hash());
+    auto const other = makeColumn(0, 0.0);
+    CHECK(table.hash() != other.hash());
+    CHECK_FALSE(table.operator==(other));
+  }
+}
+
+TEST_CASE("Hash-consed expressions", "[expressions][hashing]") {
+  using boss::expressions::SharedExpressionNode;
+  auto factory = boss::expressions::HashConsingFactory();
+  auto projection = [] {
+    return "Project"_("Table"_(), "As"_("Revenue"_, "Times"_("Price"_, "Discount"_)));
+  };
+  auto plan = "Join"_("Select"_(projection(), "Greater"_("Revenue"_, 10)),
+                      "Select"_(projection(), "Greater"_("Revenue"_, 20)));
+  auto const planHash = plan.hash();
+  auto const root = factory.intern(std::move(plan));
+  CHECK(root->getHash() == planHash); // the same as the hash of the tree
+  auto const& left = get<SharedExpressionNode::Pointer>(root->getArguments()[0]);
+  auto const& right = get<SharedExpressionNode::Pointer>(root->getArguments()[1]);
+  CHECK(left != right);
+  CHECK(left->getArguments()[0] == right->getArguments()[0]); // the projections are shared
+  // Join, 2 Selects, 2 Greaters, Project, Table, As and Times
+  CHECK(factory.size() == 9);
+
+  auto const again = factory.intern(projection());
+  CHECK(again == get<SharedExpressionNode::Pointer>(left->getArguments()[0]));
+  CHECK(factory.size() == 9);
+
+  auto const materialized = root->toExpression();
+  CHECK(materialized.hash() == planHash);
+  CHECK(materialized.getArguments().size() == 2);
+
+  SECTION("Shared subexpressions are evaluated once") {
+    auto evaluations = std::map<std::string, int>();
+    auto const nodes = boss::expressions::evaluateOnce<int>(
+        root, [&evaluations](SharedExpressionNode const& node, auto& evaluate) {
+          evaluations[node.getHead().getName()]++;
+          auto result = 1;
+          for(auto const& argument : node.getArguments()) {
+            if(auto const* child = std::get_if<SharedExpressionNode::Pointer>(&argument)) {
+              result += evaluate(*child);
+            }
+          }
+          return result;
+        });
+    CHECK(nodes == 13); // the nodes of the tree
+    CHECK(evaluations["Project"] == 1);
+    CHECK(evaluations["Times"] == 1);
+    CHECK(evaluations["Select"] == 2);
+  }
+
+  SECTION("Spans") {
+    auto makeColumn = [] {
+      return "Column"_(boss::Span<int64_t>(vector<int64_t>{1, 2, 3}));
+    };
+    auto const column = factory.intern(makeColumn());
+    CHECK(factory.intern(makeColumn()) == column);
+    auto other = "Column"_(boss::Span<int64_t>(vector<int64_t>{1, 2, 4}));
+    CHECK(factory.intern(std::move(other)) != column);
+    auto const first = column->toExpression();
+    auto const second = column->toExpression();
+    CHECK(std::get<boss::Span<int64_t>>(first.getSpanArguments()[0]).begin() ==
+          std::get<boss::Span<int64_t>>(second.getSpanArguments()[0]).begin()); // not copied
+  }
+
+  SECTION("Nodes that are no longer referenced are purged") {
+    for(auto i = 0; i < 1000; i++) {
+      factory.intern("Greater"_("Revenue"_, i));
+    }
+    CHECK(factory.size() == 9);
+    CHECK(factory.tableSize() < 100);
+    factory.purge();
+    CHECK(factory.tableSize() == 9);
+  }
+}
+
 TEST_CASE("Expression Transformation", "[expressions]") {
   auto v1 = GENERATE(take(3, random<std::int64_t>(1, 100)));
   auto v2 = GENERATE(take(3, random<std::int64_t>(1, 100)));
@@ -427,6 +659,971 @@ TEMPLATE_TEST_CASE("Cloning Expressions with numeric Spans", "[spans][clone]", s
   }
 }
 
+TEST_CASE("Cloning shared Spans", "[spans][clone]") {
+  auto span = boss::Span<int64_t>(vector<int64_t>{1, 2, 3}).share();
+  REQUIRE(span.isShared());
+  auto clone = span.clone(CloneReason::FOR_TESTING);
+  CHECK(clone.isShared());
+  CHECK(clone.begin() == span.begin());
+
+  SECTION("Writing to a clone copies the values") {
+    clone.makeWritable()[0] = 4;
+    CHECK(clone.begin() != span.begin());
+    CHECK(clone[0] == 4);
+    CHECK(span[0] == 1);
+    auto const* values = clone.begin();
+    clone.makeWritable(); // exclusively owned already
+    CHECK(clone.begin() == values);
+  }
+
+  SECTION("Values outlive the original span") {
+    span = boss::Span<int64_t>();
+    CHECK(clone[2] == 3);
+  }
+
+  SECTION("Sharing a non-owning span copies the values") {
+    auto values = vector<int64_t>{1, 2, 3};
+    auto shared = boss::Span<int64_t>(values).share();
+    CHECK(shared.begin() != values.data());
+    CHECK(shared[1] == 2);
+  }
+
+  SECTION("Cloning a complex expression shares the spans") {
+    auto expression = "duh"_(boss::Span<int64_t const>(vector<int64_t>{1, 2, 3}).share());
+    auto clonedExpression = expression.clone(CloneReason::FOR_TESTING);
+    CHECK(get<int64_t>(clonedExpression.getArguments().at(1)) == 2);
+    CHECK(std::get<boss::Span<int64_t>>(clonedExpression.getSpanArguments().at(0)).begin() ==
+          std::get<boss::Span<int64_t const>>(expression.getSpanArguments().at(0)).begin());
+  }
+}
+
+TEST_CASE("Cloning shared expressions", "[expressions][clone]") {
+  auto expression = "Table"_("Key"_(boss::Span<int64_t>(vector<int64_t>{1, 2, 3})),
+                             "Flag"_(boss::Span<bool>(vector<bool>{true, false})))
+                        .share();
+  auto const& keys = get<boss::ComplexExpression>(expression.getArguments().at(0));
+  auto const* values = std::get<boss::Span<int64_t>>(keys.getSpanArguments().at(0)).begin();
+
+  auto& counters = boss::expressions::CloneCounters::global();
+  counters.reset();
+  counters.enable();
+  auto clone = expression.clone(CloneReason::FOR_TESTING);
+  counters.enable(false);
+  CHECK(counters[CloneReason::FOR_TESTING] > 0);
+  CHECK(counters[CloneReason::EXPRESSION_WRAPPING] == 0);
+  auto const count = counters[CloneReason::FOR_TESTING];
+  auto uncounted = expression.clone(CloneReason::FOR_TESTING);
+  CHECK(counters[CloneReason::FOR_TESTING] == count); // not counted while disabled
+
+  auto& clonedKeys = get<boss::ComplexExpression>(clone.getArguments().at(0));
+  CHECK(std::get<boss::Span<int64_t>>(clonedKeys.getSpanArguments().at(0)).begin() == values);
+
+  SECTION("Writing to a clone copies the values") {
+    clone.makeWritable();
+    auto& writableKeys = get<boss::ComplexExpression>(clone.getArguments().at(0));
+    CHECK(std::get<boss::Span<int64_t>>(writableKeys.getSpanArguments().at(0)).begin() !=
+          values);
+    get<int64_t>(writableKeys.getArguments().at(1)) = 4;
+    CHECK(get<int64_t>(writableKeys.getArguments().at(1)) == 4);
+    CHECK(values[1] == 2);
+  }
+
+  SECTION("Reading through the arguments of a clone does not copy the values") {
+    CHECK(get<int64_t>(clonedKeys.getArguments().at(1)) == 2);
+    CHECK(get<int64_t>(clonedKeys.getArguments()[2]) == 3);
+    CHECK(std::get<boss::Span<int64_t>>(clonedKeys.getSpanArguments().at(0)).begin() == values);
+  }
+
+  SECTION("String and dictionary-encoded spans are made writable") {
+    auto spans = boss::expressions::ExpressionSpanArguments();
+    spans.emplace_back(boss::expressions::StringSpan(vector<string>{"AIR", "MAIL"}));
+    spans.emplace_back(boss::expressions::DictionarySpan<string>::encode({"R", "A", "R"}));
+    auto strings = ComplexExpression("Strings"_, {}, {}, std::move(spans)).share();
+    auto stringsClone = strings.clone(CloneReason::FOR_TESTING);
+    auto characters = [](ComplexExpression const& expression) {
+      return std::get<boss::expressions::StringSpan>(expression.getSpanArguments().at(0))
+          .getCharacters()
+          .begin();
+    };
+    auto codes = [](ComplexExpression const& expression) {
+      return std::get<boss::expressions::DictionarySpan<string>>(
+                 expression.getSpanArguments().at(1))
+          .getCodes()
+          .begin();
+    };
+    CHECK(characters(stringsClone) == characters(strings));
+    stringsClone.makeWritable();
+    CHECK(characters(stringsClone) != characters(strings));
+    CHECK(codes(stringsClone) != codes(strings));
+    CHECK(get<std::string_view>(std::as_const(stringsClone).getArguments().at(1)) == "MAIL");
+  }
+}
+
+TEST_CASE("Memory footprint of expressions", "[expressions][footprint]") {
+  auto values = std::array<int64_t, 4>{1, 2, 3, 4};
+  auto const valueBytes = values.size() * sizeof(int64_t);
+  SECTION("Owned, shared and borrowed spans") {
+    auto owned = "Column"_(boss::Span<int64_t>(vector<int64_t>{1, 2, 3, 4}));
+    CHECK(owned.footprint().owned >= valueBytes);
+    CHECK(owned.footprint().shared == 0);
+
+    auto shared = std::move(owned).share();
+    auto clone = shared.clone(CloneReason::FOR_TESTING);
+    CHECK(clone.footprint().shared == valueBytes);
+    CHECK(clone.footprint().borrowed == 0);
+
+    auto borrowed = "Column"_(boss::Span<int64_t>(values.data(), values.size(), nullptr));
+    CHECK(borrowed.footprint().borrowed == valueBytes);
+    CHECK(borrowed.footprint().shared == 0);
+  }
+  SECTION("Shared buffers are counted once") {
+    auto shared = boss::Span<int64_t>(vector<int64_t>{1, 2, 3, 4}).share();
+    auto spans = boss::expressions::ExpressionSpanArguments();
+    spans.emplace_back(shared.clone(CloneReason::FOR_TESTING));
+    spans.emplace_back(shared.clone(CloneReason::FOR_TESTING));
+    auto table = boss::ComplexExpression("Table"_, {}, {}, std::move(spans));
+    auto nested = "List"_(table.clone(CloneReason::FOR_TESTING),
+                          table.clone(CloneReason::FOR_TESTING));
+    CHECK(table.footprint().shared == valueBytes);
+    CHECK(nested.footprint().shared == valueBytes);
+    auto engine = boss::engines::BootstrapEngine();
+    auto result = get<ComplexExpression>(engine.evaluate(
+        "MemoryFootprint"_(table.clone(CloneReason::FOR_TESTING), std::move(table))));
+    auto const& sharedBytes = get<ComplexExpression>(result.getArguments().at(1));
+    CHECK(sharedBytes.getHead() == "Shared"_);
+    CHECK(get<int64_t>(sharedBytes.getArguments().at(0)) == static_cast<int64_t>(valueBytes));
+  }
+  SECTION("Subexpressions and strings are accounted for") {
+    auto const longString = std::string(100, 'x');
+    auto expression = boss::Expression("List"_("Nested"_(longString), 1));
+    CHECK(footprint(expression).owned > sizeof(boss::Expression) + longString.size());
+  }
+  SECTION("MemoryFootprint operator") {
+    auto engine = boss::engines::BootstrapEngine();
+    auto result = get<ComplexExpression>(engine.evaluate("MemoryFootprint"_(
+        "Column"_(boss::Span<int64_t>(values.data(), values.size(), nullptr)))));
+    CHECK(result.getHead() == "Footprint"_);
+    auto const& borrowed = get<ComplexExpression>(result.getArguments().at(2));
+    CHECK(borrowed.getHead() == "Borrowed"_);
+    CHECK(get<int64_t>(borrowed.getArguments().at(0)) == static_cast<int64_t>(valueBytes));
+  }
+}
+
+namespace {
+boss::ComplexExpression deepChain(size_t depth) {
+  auto expression = "Leaf"_(1, "x"_);
+  for(auto i = size_t{}; i < depth; i++) {
+    auto arguments = boss::ExpressionArguments();
+    arguments.emplace_back(std::move(expression));
+    arguments.emplace_back(int64_t(i));
+    expression = boss::ComplexExpression("And"_, std::move(arguments));
+  }
+  return expression;
+}
+boss::ComplexExpression deepChainOfSpans(size_t depth) {
+  auto spans = boss::expressions::ExpressionSpanArguments();
+  spans.emplace_back(boss::Span<int64_t>(vector<int64_t>{1, 2, 3}));
+  auto expression = boss::ComplexExpression("Leaf"_, {}, {}, std::move(spans));
+  for(auto i = size_t{}; i < depth; i++) {
+    auto arguments = boss::ExpressionArguments();
+    arguments.emplace_back(std::move(expression));
+    expression = boss::ComplexExpression("Not"_, std::move(arguments));
+  }
+  return expression;
+}
+} // namespace
+
+TEST_CASE("Deep expressions do not overflow the stack", "[expressions][deep]") {
+  auto const depth = size_t{200000};
+  SECTION("Cloning and comparing") {
+    auto expression = deepChainOfSpans(depth);
+    auto clone = expression.clone(CloneReason::FOR_TESTING);
+    CHECK(clone == expression);
+    CHECK(deepChainOfSpans(depth - 1) != expression);
+  }
+  SECTION("Sharing and making writable") {
+    auto leafValues = [](boss::ComplexExpression const& expression) {
+      auto const* node = &expression;
+      while(!node->getDynamicArguments().empty()) {
+        node = &get<boss::ComplexExpression>(node->getDynamicArguments()[0]);
+      }
+      return std::get<boss::Span<int64_t>>(node->getSpanArguments()[0]).begin();
+    };
+    auto shared = deepChainOfSpans(depth).share();
+    auto clone = shared.clone(CloneReason::FOR_TESTING);
+    CHECK(clone.footprint().shared == 3 * sizeof(int64_t));
+    CHECK(leafValues(clone) == leafValues(shared));
+    clone.makeWritable();
+    CHECK(leafValues(clone) != leafValues(shared));
+    CHECK(clone == shared);
+  }
+  auto expression = deepChain(depth);
+  SECTION("Hashing") {
+    CHECK(expression.hash() == deepChain(depth).hash());
+    CHECK(expression.hash() != deepChain(depth - 1).hash());
+  }
+  SECTION("Footprint") {
+    auto const bytes = expression.footprint();
+    CHECK(bytes.owned >= depth * sizeof(boss::Expression));
+    CHECK(bytes.shared == 0);
+    CHECK(deepChainOfSpans(depth).footprint().owned >= 3 * sizeof(int64_t));
+  }
+  SECTION("Hash-consing") {
+    using boss::expressions::SharedExpressionNode;
+    auto factory = boss::expressions::HashConsingFactory();
+    auto const root = factory.intern(deepChain(depth));
+    CHECK(root->getHash() == expression.hash());
+    CHECK(factory.size() == depth + 1);
+    CHECK(root->toExpression().hash() == expression.hash());
+    auto const nodes = boss::expressions::evaluateOnce<size_t>(
+        root, [](SharedExpressionNode const& node, auto& evaluate) {
+          auto result = size_t{1};
+          for(auto const& argument : node.getArguments()) {
+            if(auto const* child = std::get_if<SharedExpressionNode::Pointer>(&argument)) {
+              result += evaluate(*child);
+            }
+          }
+          return result;
+        });
+    CHECK(nodes == depth + 1);
+  }
+  SECTION("Printing") {
+    auto out = std::stringstream();
+    out << deepChain(3);
+    CHECK(out.str() == "And[And[And[Leaf[1,x],0],1],2]");
+    out << expression;
+    CHECK(out.str().size() > 2 * depth);
+  }
+  SECTION("Traversing") {
+    auto maxDepth = size_t{};
+    auto leaves = 0;
+    boss::algorithm::traverse(
+        expression, [&maxDepth](auto const& /*e*/, size_t d) { maxDepth = std::max(maxDepth, d); },
+        [&leaves](auto const& e, size_t /*depth*/) { leaves += e.getHead() == "Leaf"_ ? 1 : 0; });
+    CHECK(maxDepth == depth);
+    CHECK(leaves == 1);
+    auto visited = 0;
+    boss::algorithm::traverse(expression, [&visited](auto const& /*e*/, size_t /*depth*/) {
+      visited++;
+      return false;
+    });
+    CHECK(visited == 1);
+  }
+  SECTION("Serializing") {
+    auto deserialized = boss::serialization::SerializedExpression(
+                            boss::Expression(expression.clone(CloneReason::FOR_TESTING)))
+                            .deserialize();
+    auto expected = std::stringstream();
+    auto actual = std::stringstream();
+    expected << expression;
+    actual << get<boss::ComplexExpression>(deserialized);
+    CHECK(actual.str() == expected.str());
+  }
+}
+
+TEST_CASE("Traversing and rewriting expression trees", "[expressions][algorithm]") {
+  auto node = [](boss::Symbol const& head, auto&&... arguments) {
+    return boss::ComplexExpression(
+        head, boss::ExpressionArguments(std::forward<decltype(arguments)>(arguments)...));
+  };
+  auto expression = node("Plus"_, node("Times"_, int64_t{2}, int64_t{3}),
+                         node("Plus"_, int64_t{1}, node("Minus"_, int64_t{5}, int64_t{4})), "x"_);
+  auto heads = std::string();
+  auto appendHead = [&heads](auto const& e) { heads += e.getHead().getName() + " "; };
+
+  SECTION("Pre-order and post-order") {
+    CHECK(boss::algorithm::forEachPreOrder(expression, appendHead));
+    CHECK(heads == "Plus Times Plus Minus ");
+    heads.clear();
+    CHECK(boss::algorithm::forEachPostOrder(expression, appendHead));
+    CHECK(heads == "Times Minus Plus Plus ");
+  }
+
+  SECTION("Skipping and stopping") {
+    auto visited = std::vector<boss::Symbol>();
+    auto completed = boss::algorithm::forEachPreOrder(expression, [&visited](auto const& e) {
+      visited.push_back(e.getHead());
+      return e.getArguments().size() == 3 ? boss::algorithm::Traversal::CONTINUE
+                                          : boss::algorithm::Traversal::SKIP_ARGUMENTS;
+    });
+    CHECK(completed);
+    CHECK(visited.size() == 3); // Minus is skipped
+    visited.clear();
+    completed = boss::algorithm::forEachPostOrder(expression, [&visited](auto const& e) {
+      visited.push_back(e.getHead());
+      return e.getHead() == "Minus"_ ? boss::algorithm::Traversal::STOP
+                                     : boss::algorithm::Traversal::CONTINUE;
+    });
+    CHECK_FALSE(completed);
+    CHECK(visited.size() == 2);
+  }
+
+  SECTION("Bottom-up rewriting") {
+    auto const* storage = expression.getDynamicArguments().data();
+    auto evaluated = boss::algorithm::rewriteBottomUp(
+        std::move(expression), [](boss::ComplexExpression&& e) -> boss::Expression {
+          auto const& arguments = e.getDynamicArguments();
+          if(arguments.size() != 2 || !std::holds_alternative<int64_t>(arguments[0]) ||
+             !std::holds_alternative<int64_t>(arguments[1])) {
+            return std::move(e);
+          }
+          auto const left = std::get<int64_t>(arguments[0]);
+          auto const right = std::get<int64_t>(arguments[1]);
+          return e.getHead() == "Plus"_    ? left + right
+                 : e.getHead() == "Times"_ ? left * right
+                                           : left - right;
+        });
+    auto const& result = get<boss::ComplexExpression>(evaluated);
+    CHECK(result.getHead() == "Plus"_);
+    CHECK(result.getDynamicArguments().data() == storage); // the arguments were rewritten in place
+    CHECK(get<int64_t>(result.getDynamicArguments().at(0)) == 6);
+    CHECK(get<int64_t>(result.getDynamicArguments().at(1)) == 2);
+    CHECK(get<boss::Symbol>(result.getDynamicArguments().at(2)) == "x"_);
+  }
+
+  SECTION("Skipping and stopping a rewrite") {
+    auto rewritten = std::vector<boss::Symbol>();
+    auto renameTimes = [&rewritten](boss::ComplexExpression&& e) -> boss::Expression {
+      rewritten.push_back(e.getHead());
+      if(e.getHead() != "Times"_) {
+        return std::move(e);
+      }
+      auto [head, unused, arguments, spans] = std::move(e).decompose();
+      return boss::ComplexExpression("Product"_, {}, std::move(arguments), std::move(spans));
+    };
+    auto headOf = [](boss::Expression const& e) {
+      return get<boss::ComplexExpression>(e).getHead();
+    };
+    auto skipped = boss::algorithm::rewriteBottomUp(
+        expression.clone(CloneReason::FOR_TESTING),
+        [](auto const& e, size_t /*depth*/) {
+          return e.getHead() != "Plus"_ || e.getArguments().size() == 3;
+        },
+        renameTimes);
+    CHECK(rewritten.size() == 3); // the arguments of the inner Plus are skipped
+    auto const& skippedArguments = get<boss::ComplexExpression>(skipped).getDynamicArguments();
+    CHECK(headOf(skippedArguments.at(0)) == "Product"_);
+    CHECK(headOf(skippedArguments.at(1)) == "Plus"_);
+
+    rewritten.clear();
+    auto const* storage = expression.getDynamicArguments().data();
+    auto stopped = boss::algorithm::rewriteBottomUp(
+        std::move(expression),
+        [](auto const& e, size_t /*depth*/) {
+          return e.getHead() == "Minus"_ ? boss::algorithm::Traversal::STOP
+                                         : boss::algorithm::Traversal::CONTINUE;
+        },
+        renameTimes);
+    CHECK(rewritten.size() == 1); // only Times was rewritten before the rewrite was stopped
+    auto const& stoppedRoot = get<boss::ComplexExpression>(stopped);
+    CHECK(stoppedRoot.getHead() == "Plus"_);
+    CHECK(stoppedRoot.getDynamicArguments().data() == storage); // left in place
+    CHECK(headOf(stoppedRoot.getDynamicArguments().at(0)) == "Product"_);
+    auto const& innerPlus = get<boss::ComplexExpression>(stoppedRoot.getDynamicArguments().at(1));
+    CHECK(headOf(innerPlus.getDynamicArguments().at(1)) == "Minus"_);
+  }
+}
+
+TEST_CASE("Spans release their owner exactly once", "[spans]") {
+  static_assert(sizeof(boss::Span<int64_t>) == 7 * sizeof(void*));
+  auto releases = 0;
+  auto values = std::array<int64_t, 3>{1, 2, 3};
+  auto release = [](void* counter) { ++*static_cast<int*>(counter); };
+
+  SECTION("Moved spans") {
+    {
+      auto span = boss::Span<int64_t>(values.data(), values.size(), &releases, release);
+      auto moved = std::move(span);
+      CHECK(moved[2] == 3);
+    }
+    CHECK(releases == 1);
+  }
+
+  SECTION("Overwritten spans") {
+    auto span = boss::Span<int64_t>(values.data(), values.size(), &releases, release);
+    span = boss::Span<int64_t>(vector<int64_t>{4});
+    CHECK(releases == 1);
+    CHECK(span[0] == 4);
+  }
+
+  SECTION("Shared spans") {
+    {
+      auto span = boss::Span<int64_t>(values.data(), values.size(), &releases, release).share();
+      auto clone = span.clone(CloneReason::FOR_TESTING);
+      span = boss::Span<int64_t>();
+      CHECK(releases == 0);
+      CHECK(clone[1] == 2);
+    }
+    CHECK(releases == 1);
+  }
+
+  SECTION("std::function destructors") {
+    {
+      auto span = boss::Span<int64_t>(values.data(), values.size(), [&releases]() { releases++; });
+    }
+    CHECK(releases == 1);
+  }
+
+  SECTION("Owners without release functions are rejected") {
+    CHECK_THROWS_AS(boss::Span<int64_t>(values.data(), values.size(), &releases, nullptr),
+                    std::invalid_argument);
+    auto borrowed = boss::Span<int64_t>(values.data(), values.size(), nullptr, nullptr);
+    CHECK_FALSE(borrowed.isShared());
+    CHECK(std::move(borrowed).share().isShared());
+  }
+}
+
+TEMPLATE_TEST_CASE("Aligned Spans", "[spans]", std::int8_t, std::int32_t, std::int64_t,
+                   std::double_t) {
+  auto span = boss::Span<TestType>::allocateAligned(13);
+  REQUIRE(span.size() == 13);
+  CHECK(span.alignment() == 64);
+  CHECK(reinterpret_cast<std::uintptr_t>(span.begin()) % 64 == 0);
+  CHECK(std::all_of(span.begin(), span.begin() + 64 / sizeof(TestType),
+                    [](auto value) { return value == 0; })); // the padding is zeroed
+  span[12] = 1;
+  CHECK(span.at(12) == 1);
+  CHECK(boss::Span<TestType>(vector<TestType>(3)).alignment() == alignof(TestType));
+
+  SECTION("Subspans") {
+    auto subspan = std::move(span).subspan(2);
+    CHECK(subspan.alignment() == 2 * sizeof(TestType));
+    CHECK(reinterpret_cast<std::uintptr_t>(subspan.begin()) % subspan.alignment() == 0);
+  }
+
+  SECTION("Other alignments") {
+    auto avx512 = boss::Span<TestType>::template allocateAligned<128>(0);
+    CHECK(avx512.alignment() == 128);
+    CHECK(reinterpret_cast<std::uintptr_t>(avx512.begin()) % 128 == 0);
+    auto moved = std::move(avx512);
+    CHECK(moved.alignment() == 128);
+  }
+}
+
+TEST_CASE("Memory-mapped Spans", "[spans]") {
+  auto const path = (std::filesystem::temp_directory_path() / "BOSSTestsMappedSpan.bin").string();
+  auto values = vector<int64_t>(1000);
+  std::iota(values.begin(), values.end(), 0);
+  {
+    auto file = std::ofstream(path, std::ios::binary);
+    file.write(reinterpret_cast<char const*>(values.data()),
+               static_cast<std::streamsize>(values.size() * sizeof(int64_t)));
+  }
+
+  SECTION("Whole files") {
+    auto span = boss::expressions::mapFile<int64_t const>(path);
+    REQUIRE(span.size() == values.size());
+    CHECK(std::equal(span.begin(), span.end(), values.begin()));
+  }
+
+  SECTION("Regions of files") {
+    auto span = boss::expressions::mapFile<int64_t const>(path, 600 * sizeof(int64_t), 10);
+    REQUIRE(span.size() == 10);
+    CHECK(span[0] == 600);
+    CHECK(span[9] == 609);
+    CHECK_THROWS_AS(boss::expressions::mapFile<int64_t const>(path, 600 * sizeof(int64_t), 401),
+                    std::out_of_range);
+  }
+
+  SECTION("Offsets have to be aligned") {
+    CHECK_THROWS_AS(boss::expressions::mapFile<int64_t const>(path, 3), std::invalid_argument);
+    CHECK(boss::expressions::mapFile<std::int8_t const>(path, 3).size() ==
+          values.size() * sizeof(int64_t) - 3);
+  }
+
+  SECTION("Modifications are private") {
+    {
+      auto span = boss::expressions::mapFile<int64_t>(path);
+      span[0] = 42;
+      CHECK(span[0] == 42);
+    }
+    CHECK(boss::expressions::mapFile<int64_t const>(path)[0] == 0);
+  }
+
+  SECTION("Mapped spans are arguments of complex expressions") {
+    auto const expression = "Column"_(boss::expressions::mapFile<int64_t const>(path));
+    CHECK(expression.getArguments().at(999) == 999);
+  }
+
+  CHECK_THROWS_AS(boss::expressions::mapFile<int64_t const>(path + ".missing"), std::runtime_error);
+  std::filesystem::remove(path);
+}
+
+TEST_CASE("Chunked columns", "[spans][chunks]") {
+  using boss::expressions::ChunkedColumn;
+  auto column = ChunkedColumn<int64_t>(boss::Span<int64_t>(vector<int64_t>{0, 1, 2}));
+  auto batch = boss::Span<int64_t>(vector<int64_t>{3, 4});
+  auto const* batchValues = batch.begin();
+  column.append(std::move(batch)).append(boss::Span<int64_t>());
+  REQUIRE(column.size() == 5);
+  CHECK(column.chunkCount() == 2);
+  CHECK(column.chunk(1).begin() == batchValues); // appending does not copy
+
+  auto other = ChunkedColumn<int64_t>(boss::Span<int64_t>(vector<int64_t>{5, 6, 7, 8}));
+  column = ChunkedColumn<int64_t>::concat(std::move(column), std::move(other));
+  REQUIRE(column.size() == 9);
+  CHECK(column.chunkCount() == 3);
+  CHECK(other.empty());
+
+  for(auto i = 0U; i < column.size(); i++) {
+    CHECK(column[i] == i);
+  }
+  CHECK(column.chunkIndexOf(4) == 1);
+  CHECK(column.chunkIndexOf(5) == 2);
+  CHECK_THROWS_AS(column.at(9), std::out_of_range);
+  CHECK(std::accumulate(column.begin(), column.end(), int64_t{}) == 36);
+
+  auto sum = int64_t{};
+  column.forEachChunk([&sum](auto const& chunk, size_t offset) {
+    CHECK(chunk[0] == static_cast<int64_t>(offset));
+    sum = std::accumulate(chunk.begin(), chunk.end(), sum);
+  });
+  CHECK(sum == 36);
+
+  SECTION("Replacing chunks updates the offsets") {
+    auto replaced = column.replaceChunk(1, boss::Span<int64_t>(vector<int64_t>{3, 4, 42}));
+    CHECK(replaced.begin() == batchValues);
+    REQUIRE(column.size() == 10);
+    CHECK(column[5] == 42);
+    CHECK(column[6] == 5);
+    column.replaceChunk(0, boss::Span<int64_t>());
+    CHECK(column.chunkCount() == 2);
+    CHECK(column[0] == 3);
+    column.forEachChunk([](auto& chunk, size_t /*offset*/) {
+      chunk = std::move(chunk).subspan(1);
+    });
+    CHECK(column.size() == 5);
+    CHECK(column[2] == 6);
+  }
+
+  SECTION("Chunks are span arguments") {
+    auto expression = ComplexExpression("Column"_, {}, {}, std::move(column).toSpanArguments());
+    CHECK(expression.getArguments().size() == 9);
+    CHECK(expression.getArguments().at(7) == 7);
+    auto roundTrip =
+        ChunkedColumn<int64_t>::fromSpanArguments(std::move(expression).getSpanArguments());
+    CHECK(roundTrip.chunkCount() == 3);
+    CHECK(roundTrip.chunk(1).begin() == batchValues);
+    auto mismatchingSpans =
+        boss::expressions::ExpressionSpanArguments(boss::Span<int64_t>(vector<int64_t>{1}));
+    CHECK_THROWS_AS(ChunkedColumn<int32_t>::fromSpanArguments(std::move(mismatchingSpans)),
+                    std::bad_variant_access);
+  }
+}
+
+TEST_CASE("Indexed access to many span arguments", "[spans][chunks]") {
+  auto spans = boss::expressions::ExpressionSpanArguments();
+  auto const chunks = 1000;
+  for(auto chunk = 0; chunk < chunks; chunk++) {
+    // chunks of different sizes (including empty ones) and types
+    auto values = vector<int64_t>(chunk % 4);
+    std::iota(values.begin(), values.end(), int64_t(chunk) * 4);
+    spans.emplace_back(boss::Span<int64_t>(std::move(values)));
+  }
+  spans.emplace_back(boss::Span<bool>(vector<bool>{true, false}));
+  auto const expression =
+      ComplexExpression("Column"_, {}, boss::ExpressionArguments("first"_), std::move(spans));
+  auto const size = size_t(1 + chunks / 4 * (1 + 2 + 3) + 2);
+  REQUIRE(expression.getArguments().size() == size);
+  CHECK(get<boss::Symbol>(expression.getArguments().at(0)) == "first"_);
+  CHECK(get<int64_t>(expression.getArguments().at(1)) == 4);
+  CHECK(get<int64_t>(expression.getArguments().at(2)) == 8);
+  CHECK(get<int64_t>(expression.getArguments()[3]) == 9);
+  CHECK(get<int64_t>(expression.getArguments().at(size - 3)) == (chunks - 1) * 4 + 2);
+  CHECK(expression.getArguments().at(size - 1) == false);
+  CHECK(expression.getArguments().isValid(size - 1));
+  CHECK_THROWS_AS(expression.getArguments().at(size), std::out_of_range);
+  CHECK_THROWS_AS(expression.getArguments().isValid(size), std::out_of_range);
+
+  auto const clone = expression.clone(boss::expressions::CloneReason::FOR_TESTING);
+  CHECK(clone.getArguments().size() == size);
+  CHECK(get<int64_t>(clone.getArguments().at(size - 3)) == (chunks - 1) * 4 + 2);
+
+  auto converted = boss::ExtensibleExpressionSystem<DummyAtom>::ComplexExpression(
+      expression.clone(boss::expressions::CloneReason::FOR_TESTING));
+  CHECK(converted.getArguments().size() == size);
+  auto [head, statics, dynamics, spanArguments] = std::move(converted).decompose();
+  CHECK(spanArguments.size() == chunks + 1);
+  CHECK(converted.getArguments().empty());
+
+  SECTION("A single span needs no offsets") {
+    auto single = boss::expressions::ExpressionSpanArguments();
+    single.emplace_back(boss::Span<int64_t>(vector<int64_t>{1, 2, 3}));
+    auto const column =
+        ComplexExpression("Column"_, {}, boss::ExpressionArguments("first"_), std::move(single));
+    REQUIRE(column.getArguments().size() == 4);
+    CHECK(get<int64_t>(column.getArguments().at(3)) == 3);
+    CHECK_THROWS_AS(column.getArguments().at(4), std::out_of_range);
+  }
+
+  SECTION("Expressions do not grow with the offsets") {
+    // the offsets (and the cached hash) are allocated on demand: besides the head, the (padded)
+    // empty static arguments and the argument vectors, only a pointer is kept inline
+    CHECK(sizeof(ComplexExpression) <= sizeof(boss::Symbol) + sizeof(void*) +
+                                           sizeof(boss::ExpressionArguments) +
+                                           sizeof(boss::expressions::ExpressionSpanArguments) +
+                                           sizeof(void*));
+  }
+}
+
+TEST_CASE("Bulk iteration over span arguments", "[spans][chunks]") {
+  using boss::algorithm::forEachSpan;
+  auto spans = boss::expressions::ExpressionSpanArguments();
+  spans.emplace_back(boss::Span<int64_t>(vector<int64_t>{1, 2, 3}));
+  spans.emplace_back(boss::Span<int64_t>(vector<int64_t>{4, 5}));
+  spans.emplace_back(boss::Span<double_t>(vector<double_t>{0.5}));
+  auto const* firstValues = std::get<boss::Span<int64_t>>(spans[0]).begin();
+  auto const expression =
+      ComplexExpression("Table"_, {}, boss::ExpressionArguments(1, 2), std::move(spans));
+
+  auto sum = int64_t{};
+  auto doubles = double_t{};
+  auto spanCount = 0;
+  forEachSpan(expression, boss::utilities::overload(
+                              [&](int64_t const* data, size_t size) {
+                                if(spanCount++ == 0) {
+                                  CHECK(data == firstValues); // the values are not copied
+                                }
+                                sum = std::accumulate(data, data + size, sum);
+                              },
+                              [&](double_t const* data, size_t size) {
+                                spanCount++;
+                                doubles = std::accumulate(data, data + size, doubles);
+                              },
+                              [](auto const& /*otherSpan*/) { FAIL(); }));
+  CHECK(spanCount == 3);
+  CHECK(sum == 15); // dynamic arguments are not visited
+  CHECK(doubles == 0.5);
+
+  SECTION("Spans the visitor does not accept") {
+    CHECK_THROWS_AS(forEachSpan(expression, [](int64_t const* /*data*/, size_t /*size*/) {}),
+                    std::invalid_argument);
+    auto bitmapSpans = boss::expressions::ExpressionSpanArguments(
+        boss::Span<bool>(vector<bool>{true, false, true}));
+    auto const bitmaps = ComplexExpression("Bitmaps"_, {}, {}, std::move(bitmapSpans));
+    auto trueCount = size_t{};
+    forEachSpan(bitmaps, boss::utilities::overload(
+                             [](bool const* /*data*/, size_t /*size*/) { FAIL(); },
+                             [&trueCount](boss::Span<bool> const& bitmap) {
+                               trueCount += boss::kernels::popcount(bitmap);
+                             },
+                             [](auto const& /*otherSpan*/) { FAIL(); }));
+    CHECK(trueCount == 2);
+  }
+}
+
+TEST_CASE("String spans", "[spans][strings]") {
+  auto strings = vector<string>{"MEDIUM POLISHED TIN", "", "hello world"};
+  auto span = boss::expressions::StringSpan(strings);
+  REQUIRE(span.size() == 3);
+  CHECK(span[0] == "MEDIUM POLISHED TIN");
+  CHECK(span[1].empty());
+  CHECK(span.at(2) == "hello world");
+  CHECK_THROWS_AS(span.at(3), std::out_of_range);
+  CHECK(span.getCharacters().size() == 30);
+
+  SECTION("Subspans and clones") {
+    auto clone = span.clone(CloneReason::FOR_TESTING);
+    auto subspan = std::move(span).subspan(1);
+    REQUIRE(subspan.size() == 2);
+    CHECK(subspan[1] == "hello world");
+    CHECK(clone[0] == "MEDIUM POLISHED TIN");
+    auto shared = std::move(clone).share();
+    CHECK(shared.clone(CloneReason::FOR_TESTING).getCharacters().begin() ==
+          shared.getCharacters().begin());
+  }
+
+  SECTION("String spans are span arguments") {
+    auto spans = boss::expressions::ExpressionSpanArguments();
+    spans.emplace_back(std::move(span));
+    auto const expression = boss::ComplexExpression("Name"_, {}, {}, std::move(spans));
+    REQUIRE(expression.getArguments().size() == 3);
+    CHECK(get<std::string_view>(expression.getArguments().at(2)) == "hello world");
+    CHECK(holds_alternative<std::string_view>(expression.getArguments().at(0)));
+    auto const first = expression.getArguments().at(0);
+    CHECK(get_if<std::string_view>(&first) != nullptr);
+    CHECK(visit([](auto const& value) -> string {
+            if constexpr(std::is_same_v<std::decay_t<decltype(value)>, string>) {
+              return value;
+            }
+            return "";
+          }, expression.getArguments().at(0)) == "MEDIUM POLISHED TIN");
+    auto const* characters = std::get<boss::expressions::StringSpan>(
+                                 expression.getSpanArguments().front())
+                                 .getCharacters()
+                                 .begin();
+    CHECK(visit(boss::utilities::overload([](auto const& /*value*/) { return false; },
+                                          [characters](std::string_view value) {
+                                            return value.data() == characters + 19;
+                                          }),
+                expression.getArguments().at(2)));
+    CHECK(visit(boss::utilities::overload([](auto const& /*value*/) { return ""s; },
+                                          [](std::string const& value) { return value; }),
+                expression.getArguments().at(2)) == "hello world");
+    auto cloned = expression.clone(CloneReason::FOR_TESTING);
+    CHECK(get<std::string_view>(std::as_const(cloned).getArguments().at(0)) ==
+          "MEDIUM POLISHED TIN");
+  }
+}
+
+TEST_CASE("Dictionary-encoded spans", "[spans][dictionaries]") {
+  auto span = boss::expressions::DictionarySpan<string>::encode({"R", "A", "N", "N", "R", "A"});
+  REQUIRE(span.size() == 6);
+  CHECK(span.getDictionary()->size() == 3);
+  CHECK(span[2] == "N");
+  CHECK(span.at(5) == "A");
+  CHECK_THROWS_AS(span.at(6), std::out_of_range);
+  CHECK(span.getCodes()[0] == span.getCodes()[4]);
+  CHECK(span.codeOf("N") == 2);
+  CHECK_FALSE(span.codeOf("O").has_value());
+  CHECK(span.decode()[1] == "A");
+
+  SECTION("Subspans and clones share the dictionary") {
+    auto clone = span.clone(CloneReason::FOR_TESTING);
+    auto subspan = std::move(span).subspan(2, 3);
+    REQUIRE(subspan.size() == 3);
+    CHECK(subspan[2] == "R");
+    CHECK(subspan.getDictionary() == clone.getDictionary());
+  }
+
+  SECTION("Dictionary-encoded spans are span arguments") {
+    auto spans = boss::expressions::ExpressionSpanArguments();
+    spans.emplace_back(std::move(span));
+    spans.emplace_back(boss::expressions::DictionarySpan<boss::Symbol>::encode(
+        {"BUILDING"_, "MACHINERY"_, "BUILDING"_}));
+    auto const expression = boss::ComplexExpression("Flags"_, {}, {}, std::move(spans));
+    REQUIRE(expression.getArguments().size() == 9);
+    CHECK(get<string>(expression.getArguments().at(1)) == "A");
+    CHECK(get<boss::Symbol>(expression.getArguments().at(7)) == "MACHINERY"_);
+    auto cloned = expression.clone(CloneReason::FOR_TESTING);
+    CHECK(get<string>(std::as_const(cloned).getArguments().at(3)) == "N");
+    CHECK(std::holds_alternative<boss::expressions::DictionarySpan<string>>(
+        cloned.getSpanArguments().at(0)));
+  }
+}
+
+TEST_CASE("Nullable Spans", "[spans][nulls]") {
+  auto span = boss::Span<int64_t>(vector<int64_t>{1, 0, 3, 0, 5})
+                  .withValidity(boss::Span<bool>(vector<bool>{true, false, true, false, true}));
+  REQUIRE(span.isNullable());
+  CHECK(span.isValid(0));
+  CHECK_FALSE(span.isValid(3));
+  CHECK(boss::kernels::nullCount(span) == 2);
+  CHECK(boss::kernels::nullCount(boss::Span<int64_t>(vector<int64_t>{1, 2})) == 0);
+  CHECK_THROWS_AS(boss::Span<int64_t>(vector<int64_t>{1}).withValidity(
+                      boss::Span<bool>(vector<bool>{true, false})),
+                  std::invalid_argument);
+
+  SECTION("Validity is carried through moves, subspans, clones and shares") {
+    auto clone = span.clone(CloneReason::FOR_TESTING);
+    CHECK_FALSE(clone.isValid(1));
+    auto moved = std::move(span);
+    auto subspan = std::move(moved).subspan(1, 3);
+    CHECK_FALSE(subspan.isValid(0));
+    CHECK(subspan.isValid(1));
+    CHECK(boss::kernels::nullCount(subspan) == 2);
+    auto shared = std::move(clone).share();
+    auto sharedClone = shared.clone(CloneReason::FOR_TESTING);
+    CHECK(sharedClone.getValidity()->words() == shared.getValidity()->words());
+    sharedClone.makeWritable();
+    CHECK(sharedClone.getValidity()->words() != shared.getValidity()->words());
+    CHECK_FALSE(sharedClone.isValid(3));
+  }
+
+  SECTION("Null arguments of complex expressions") {
+    auto const expression = "Column"_(std::move(span));
+    CHECK(expression.getArguments().isValid(2));
+    CHECK_FALSE(expression.getArguments().isValid(3));
+    CHECK_THROWS_AS(expression.getArguments().isValid(5), std::out_of_range);
+    auto cloned = expression.clone(CloneReason::FOR_TESTING);
+    CHECK_FALSE(cloned.getArguments().isValid(1));
+  }
+}
+
+TEST_CASE("Span statistics", "[spans][statistics]") {
+  auto values = vector<int64_t>(10000);
+  std::iota(values.begin(), values.end(), -5000);
+  auto span = boss::Span<int64_t>(std::move(values));
+  CHECK_FALSE(span.hasStatistics());
+  auto const& statistics = span.statistics();
+  CHECK(span.hasStatistics());
+  CHECK(&span.statistics() == &statistics);
+  CHECK(statistics.min == -5000);
+  CHECK(statistics.max == 4999);
+  CHECK(statistics.nullCount == 0);
+  CHECK(statistics.sorted);
+  CHECK(statistics.distinctCount == Catch::Detail::Approx(10000).epsilon(0.1));
+
+  SECTION("Statistics are invalidated by writes through makeWritable and by subspans") {
+    auto clone = span.clone(CloneReason::FOR_TESTING);
+    CHECK(clone.hasStatistics());
+    clone.makeWritable()[0] = 10000;
+    CHECK(clone.statistics().max == 10000);
+    CHECK_FALSE(clone.statistics().sorted);
+    auto subspan = std::move(span).subspan(10, 5);
+    CHECK(subspan.statistics().min == -4990);
+    CHECK(subspan.statistics().distinctCount == 5);
+  }
+
+  SECTION("Null values are ignored") {
+    auto nullable = boss::Span<double>(vector<double>{3.5, -100, 1.5, 1.5})
+                        .withValidity(boss::Span<bool>(vector<bool>{true, false, true, true}));
+    CHECK(nullable.statistics().min == 1.5);
+    CHECK(nullable.statistics().nullCount == 1);
+    CHECK_FALSE(nullable.statistics().sorted);
+    CHECK(nullable.statistics().distinctCount == 2);
+  }
+
+  SECTION("Statistics of strings") {
+    auto strings = boss::Span<string const>(vector<string>{"AIR", "MAIL", "SHIP"});
+    CHECK(strings.statistics().min == "AIR");
+    CHECK(strings.statistics().sorted);
+  }
+}
+
+TEMPLATE_TEST_CASE("Compressed integer Spans", "[spans][compression]", int32_t, int64_t) {
+  auto values = vector<TestType>(1000);
+  for(auto i = 0U; i < values.size(); i++) {
+    values[i] = static_cast<TestType>(19920101 + (i * 7919) % 250); // "dates"
+  }
+  auto naiveBetween = [](auto const& values, TestType low, TestType high) {
+    auto result = vector<bool>();
+    for(auto value : values) {
+      result.push_back(low <= value && value <= high);
+    }
+    return result;
+  };
+  auto toVector = [](auto const& bitmap) {
+    auto result = vector<bool>();
+    for(auto i = 0U; i < bitmap.size(); i++) {
+      result.push_back(bitmap[i] == true);
+    }
+    return result;
+  };
+
+  SECTION("Frame-of-reference") {
+    auto span = boss::expressions::FrameOfReferenceSpan<TestType>::encode(values);
+    CHECK(span.getReference() == 19920101);
+    CHECK(span.getBitWidth() == 8);
+    CHECK(span.getWords().size() < values.size() * sizeof(TestType) / sizeof(uint64_t) / 2);
+    CHECK(span[999] == values[999]);
+    CHECK_THROWS_AS(span.at(1000), std::out_of_range);
+    auto decoded = span.decode();
+    CHECK(vector<TestType>(decoded.begin(), decoded.end()) == values);
+    CHECK(toVector(boss::kernels::between(span, 19920150, 19920200)) ==
+          naiveBetween(values, 19920150, 19920200));
+    CHECK(toVector(boss::kernels::between(span, 0, 19920100)) == naiveBetween(values, 0, 19920100));
+    CHECK(boss::kernels::popcount(boss::kernels::equal(span, values[10])) ==
+          static_cast<size_t>(std::count(values.begin(), values.end(), values[10])));
+
+    auto extremes = vector<TestType>{std::numeric_limits<TestType>::min(), -1, 0,
+                                     std::numeric_limits<TestType>::max()};
+    auto wide = boss::expressions::FrameOfReferenceSpan<TestType>::encode(extremes);
+    CHECK(wide.getBitWidth() == sizeof(TestType) * 8);
+    auto decodedExtremes = wide.decode();
+    CHECK(vector<TestType>(decodedExtremes.begin(), decodedExtremes.end()) == extremes);
+    CHECK(toVector(boss::kernels::between(wide, -1, 0)) ==
+          vector<bool>{false, true, true, false});
+  }
+
+  SECTION("Frame-of-reference with every bit width") {
+    using Unsigned = std::make_unsigned_t<TestType>;
+    auto const reference = std::numeric_limits<TestType>::min();
+    for(auto bitWidth = 1U; bitWidth <= sizeof(TestType) * 8; bitWidth++) {
+      auto const range = Unsigned(~Unsigned{} >> (sizeof(TestType) * 8 - bitWidth));
+      auto packed = vector<TestType>(203);
+      for(auto i = 0U; i < packed.size(); i++) {
+        packed[i] = TestType(Unsigned(reference) + (Unsigned(i * 2654435761U) & range));
+      }
+      packed[7] = TestType(Unsigned(reference) + range);
+      packed[11] = reference;
+      auto span = boss::expressions::FrameOfReferenceSpan<TestType>::encode(packed);
+      REQUIRE(span.getBitWidth() == bitWidth);
+      auto decoded = span.decode();
+      CHECK(vector<TestType>(decoded.begin(), decoded.end()) == packed);
+      auto const middle = TestType(Unsigned(reference) + range / 2);
+      CHECK(toVector(boss::kernels::between(span, reference, middle)) ==
+            naiveBetween(packed, reference, middle));
+      CHECK(toVector(boss::kernels::between(span, middle, packed[7])) ==
+            naiveBetween(packed, middle, packed[7]));
+      CHECK(toVector(boss::kernels::between(span, packed[20], packed[20])) ==
+            naiveBetween(packed, packed[20], packed[20]));
+    }
+  }
+
+  SECTION("Run-length") {
+    std::sort(values.begin(), values.end());
+    auto span = boss::expressions::RunLengthSpan<TestType>::encode(values);
+    CHECK(span.size() == values.size());
+    CHECK(span.runCount() < values.size());
+    CHECK(span[0] == values[0]);
+    CHECK(span[777] == values[777]);
+    auto decoded = span.decode();
+    CHECK(vector<TestType>(decoded.begin(), decoded.end()) == values);
+    CHECK(toVector(boss::kernels::between(span, 19920150, 19920200)) ==
+          naiveBetween(values, 19920150, 19920200));
+    CHECK(boss::kernels::popcount(boss::kernels::equal(span, values[10])) ==
+          static_cast<size_t>(std::count(values.begin(), values.end(), values[10])));
+  }
+}
+
+TEST_CASE("Spans of bools are packed bitmaps", "[spans][bitmaps]") {
+  auto values = vector<bool>(150);
+  for(auto i = 0U; i < values.size(); i++) {
+    values[i] = i % 3 == 0 || i == 149;
+  }
+  auto bitmap = boss::Span<bool>(vector<bool>(values));
+  REQUIRE(bitmap.size() == values.size());
+  CHECK(bitmap.bitOffset() == 0);
+  CHECK(bitmap.words()[0] == 0x9249249249249249ULL);
+  for(auto i = 0U; i < values.size(); i++) {
+    CHECK(bitmap[i] == values[i]);
+  }
+
+  SECTION("Bits are writable") {
+    bitmap[1] = true;
+    bitmap.at(0) = false;
+    CHECK((bitmap.words()[0] & 3U) == 2U);
+  }
+
+  SECTION("Subspans and clones") {
+    auto subspan = std::move(bitmap).subspan(70, 72);
+    CHECK(subspan.bitOffset() == 6);
+    CHECK(subspan[2] == values[72]);
+    auto clone = subspan.clone(CloneReason::FOR_TESTING);
+    CHECK(clone.bitOffset() == 0);
+    for(auto i = 0U; i < clone.size(); i++) {
+      CHECK(clone[i] == values[70 + i]);
+    }
+  }
+
+  SECTION("Kernels") {
+    auto other = boss::Span<bool const>(vector<bool>(values.size(), true));
+    CHECK(boss::kernels::popcount(bitmap) == 51);
+    CHECK(boss::kernels::popcount(boss::kernels::bitwiseAnd(bitmap, other)) == 51);
+    CHECK(boss::kernels::popcount(boss::kernels::bitwiseAndNot(other, bitmap)) == 99);
+    auto indices = boss::kernels::selectToIndex(bitmap);
+    REQUIRE(indices.size() == 51);
+    CHECK(indices[1] == 3);
+    CHECK(indices[50] == 149);
+
+    auto unaligned = std::move(bitmap).subspan(1);
+    CHECK(boss::kernels::popcount(unaligned) == 50);
+    CHECK(boss::kernels::selectToIndex(unaligned)[0] == 2);
+    CHECK(boss::kernels::popcount(boss::kernels::bitwiseAnd(
+              unaligned, std::move(other).subspan(0, unaligned.size()))) == 50);
+    CHECK_THROWS_AS(boss::kernels::bitwiseAnd(unaligned, boss::Span<bool>()),
+                    std::invalid_argument);
+  }
+
+  SECTION("Bits are arguments of complex expressions") {
+    auto expression = "Select"_(std::move(bitmap));
+    CHECK(expression.getArguments().at(0) == true);
+    CHECK(expression.getArguments().at(1) == false);
+    CHECK(expression.getArguments().at(3) == true);
+  }
+}
+
 // NOLINTNEXTLINE
 TEMPLATE_TEST_CASE("Complex Expressions with Spans", "[spans]", std::string, boss::Symbol) {
   using std::literals::string_literals::operator""s;
@@ -441,6 +1638,25 @@ TEMPLATE_TEST_CASE("Complex Expressions with Spans", "[spans]", std::string, bos
   }
 }
 
+TEST_CASE("Bootstrap operators are dispatched by head", "[bootstrap]") {
+  auto engine = boss::engines::BootstrapEngine();
+  SECTION("Unregistered heads are returned unevaluated") {
+    auto result = get<ComplexExpression>(engine.evaluate("Plus"_(5, 4)));
+    CHECK(result.getHead() == "Plus"_);
+    CHECK(get<std::int32_t>(result.getArguments().at(1)) == 4);
+    CHECK(get<std::int32_t>(engine.evaluate(boss::Expression(9))) == 9);
+  }
+  SECTION("Registered heads are evaluated") {
+    CHECK(get<std::string>(engine.evaluate("ResetEngines"_())) == "okay");
+    CHECK(get<std::string>(engine.evaluate("SetDefaultEnginePipeline"_())) == "okay");
+    CHECK_THROWS_AS(engine.evaluate("SetDefaultEnginePipeline"_(1)), std::runtime_error);
+  }
+  SECTION("Arguments of unregistered heads are not evaluated") {
+    auto result = get<ComplexExpression>(engine.evaluate("List"_("ResetEngines"_())));
+    CHECK(get<ComplexExpression>(result.getArguments().at(0)).getHead() == "ResetEngines"_);
+  }
+}
+
 TEST_CASE("Basics", "[basics]") { // NOLINT
   auto engine = boss::engines::BootstrapEngine();
   REQUIRE(!librariesToTest.empty());
@@ -1388,6 +2604,71 @@ TEST_CASE("Expression Serialization") {
   }
 }
 
+namespace {
+class CountingMemoryResource : public std::pmr::memory_resource {
+public:
+  size_t allocations = 0;
+
+private:
+  void* do_allocate(size_t bytes, size_t alignment) override {
+    allocations++;
+    return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+  }
+  void do_deallocate(void* pointer, size_t bytes, size_t alignment) override {
+    std::pmr::new_delete_resource()->deallocate(pointer, bytes, alignment);
+  }
+  bool do_is_equal(std::pmr::memory_resource const& other) const noexcept override {
+    return this == &other;
+  }
+};
+} // namespace
+
+TEST_CASE("Expressions allocated from memory resources", "[expressions][allocation]") {
+  auto resource = CountingMemoryResource();
+
+  SECTION("Builders") {
+    auto expression = "Plus"_.allocatingFrom(resource)(Expression(1), Expression("x"_));
+    CHECK(resource.allocations == 1);
+    CHECK(expression.getMemoryResource() == &resource);
+    CHECK(get<int32_t>(expression.getArguments().at(0)) == 1);
+    auto spans = "Column"_.allocatingFrom(resource)(boss::Span<int64_t>(vector<int64_t>{1, 2}));
+    CHECK(resource.allocations == 2);
+    CHECK(spans.getArguments().size() == 2);
+  }
+
+  SECTION("Deserialization") {
+    auto const plan = Expression("Select"_("Project"_("lineitem"_, "As"_("L_TAX"_, "L_TAX"_)),
+                                           "Where"_("Greater"_("L_TAX"_, 0.5))));
+    auto result = boss::serialization::SerializedExpression(plan.clone(CloneReason::FOR_TESTING))
+                      .deserialize(&resource);
+    CHECK(resource.allocations == 5); // one per complex expression
+    CHECK(get<boss::ComplexExpression>(result).getMemoryResource() == &resource);
+  }
+
+  SECTION("Arenas") {
+    auto arena = std::pmr::monotonic_buffer_resource(4096, &resource);
+    {
+      auto expression = "Where"_.allocatingFrom(arena)(Expression(
+          "Greater"_.allocatingFrom(arena)(Expression("L_TAX"_), Expression(0.5))));
+      CHECK(get<double>(get<boss::ComplexExpression>(expression.getArguments().at(0))
+                            .getArguments()
+                            .at(1)) == 0.5);
+    }
+    CHECK(resource.allocations == 1); // the arena's (only) buffer
+  }
+
+  SECTION("Complex expressions allocate their arguments at once") {
+    auto const plan = Expression("Where"_("And"_("Greater"_("L_TAX"_, 0.5), "Equal"_(1, 2, 3, 4),
+                                                 "Less"_("L_QUANTITY"_, 24), "True"_()),
+                                          "X"_, "Y"_, "Z"_));
+    auto* defaultResource = std::pmr::set_default_resource(&resource);
+    auto clone = plan.clone(CloneReason::FOR_TESTING);
+    auto arguments = boss::ExpressionArguments(Expression(1), Expression(2), Expression(3));
+    std::pmr::set_default_resource(defaultResource);
+    CHECK(resource.allocations == 6); // five complex expressions and one argument list
+  }
+}
+
 TEST_CASE("Laxy Expression Serialization") {
   auto const plans = std::array<boss::Expression, 8>{
       "HiThere"_(1, 4, 9, "You"_(1, 3), 9, 3),
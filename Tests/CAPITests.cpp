@@ -35,3 +35,16 @@ TEST_CASE("Build expression, with strings", "[api]") {
   freeBOSSArguments(result);
   CHECK(str1 == str2);
 }
+
+TEST_CASE("Null arguments", "[api]") {
+  auto spans = boss::expressions::ExpressionSpanArguments();
+  spans.emplace_back(boss::Span<int64_t>(std::vector<int64_t>{1, 0}).withValidity(
+      boss::Span<bool>(std::vector<bool>{true, false})));
+  auto* expression = new BOSSExpression{
+      boss::expressions::ComplexExpression(boss::Symbol("Column"), {}, {}, std::move(spans))};
+  auto const firstIsValid = getArgumentValidityFromBOSSExpression(expression, 0);
+  auto const secondIsValid = getArgumentValidityFromBOSSExpression(expression, 1);
+  freeBOSSExpression(expression);
+  CHECK(firstIsValid);
+  CHECK_FALSE(secondIsValid);
+}